@@ -2,6 +2,7 @@
 #include <vector>
 #include <string>
 #include <SFML/System/Vector2.hpp>
+#include "graph.hpp"
 
 
 class Biome {
@@ -84,11 +85,34 @@ public:
 
 // TODO: Biomes need names: https://en.wikipedia.org/wiki/List_of_biomes
 
+class Lake {
+public:
+	float level = 0; // Height of the lake surface
+	float maxDepth = 0; // Deepest point below the surface
+	int spill = -1; // Cell the flood entered the lake from (may be ocean or border)
+	int numCells = 0;
+	BoundingBox bounds; // Box around the sites of the lake cells
+};
+
+// Land that drains to one outlet (a watershed)
+class Basin {
+public:
+	int outlet = -1; // Cell everything drains into, an ocean cell or a land cell on the map border
+	float area = 0; // Area of the land cells (pixels squared)
+	int numCells = 0;
+};
+
+// A stretch of river between a source or confluence and the next confluence or its mouth
 class River {
 public:
-	float len = 0;
-	float maxWidth = 0;
+	float len = 0; // Length along the cells (pixels)
+	float maxWidth = 0; // Width, depth and speed at the downstream end from the discharge (hydraulic geometry)
 	float maxDepth = 0;
 	float flowSpeed = 0;
-	std::vector<int> cells;
+	float discharge = 0; // Drainage area at the downstream end (mean cells)
+	int strahler = 1; // Strahler stream order
+	int shreve = 1; // Shreve magnitude, the number of sources upstream
+	int downstream = -1; // River this one flows into, -1 when it ends in the sea or a lake
+	int first = 0; // Cells are globals.riverPath[first] up to globals.riverPath[first + count], from the source downstream
+	int count = 0; // The last cell is where it ends (a confluence, a lake or the sea)
 };
@@ -17,10 +17,23 @@ public:
 	std::vector<int> snowCells; // Cells that are covered in snow
 	std::vector<int> treeCells; // Cells that do not have trees because of altitute
 	std::vector<int> riverCells; // Cells that are part of a river
-	std::vector<int> lakeCells; // Penamn formula (Loook up)
+	std::vector<River> rivers; // Rivers built by calcRivers, Cell::river is the index
+	std::vector<int> riverPath; // Cells of all rivers back to back, each River is one range of it
+	std::vector<Basin> basins; // Drainage basins built with the rivers, Cell::basin is the index
+	std::vector<int> lakeCells; // Cells that are part of a lake
+	std::vector<Lake> lakes; // Lakes found by calcLakes, Cell::lake is the index
+	std::vector<float> filledHeight; // Heights with the lakes filled, rivers drain over this surface
 	std::vector<int> coastCells; // Cells that are part of the coast
 	std::vector<int> oceanCells; // Cells that are part of the ocean
+	std::vector<int> heightOrder; // All cells sorted by height, built by updateSeaLevel when first needed (the ocean is the start of it)
+	float coastDelta = 0.05f; // Height range around the sea level that is coast
+	Components landmasses; // Connected land, built by updateComponents and kept until heights or the sea level change
+	Components waterBodies; // Connected water (oceans and enclosed seas)
+	bool componentsValid = false;
 	std::vector<Biome> biomes; // List of biomes in the world
+	int months = 0; // Months in the seasonal tables, 0 when calcSeasons has not run
+	std::vector<unsigned short> monthTemp; // Temperature of every cell for every month (cells x months) as half floats
+	std::vector<unsigned short> monthPercepitation; // Percepitation of every cell for every month, same layout
 	std::vector<float> convergenceLines; // Convergence lines for wind and ocean currents: Given in y coordinates from 0 to 1 (0 being the top of the map) (0.5 being the equator) (The buttom of the map should not be included)
 	std::vector<float> windDirection; // Wind direction for each convergence line (0 to 360 degrees) (0 being north) (will be the direction of the wind in the zone below the convergence line)
 	std::vector<float> windStrength; // Wind strength for each convergence line (0 to 1) (1 being the strongest) (will be the strength of the wind in the zone below the convergence line)
@@ -38,6 +51,8 @@ public:
 	void setSeaLevel(float level);
 	void setGlobalSnowline(float snowline);
 	void setGlobalTreeline(float treeline);
+	float getMonthTemp(int cell, int month) const { return half_to_float(monthTemp[static_cast<std::size_t>(cell) * months + month]); }
+	float getMonthPercepitation(int cell, int month) const { return half_to_float(monthPercepitation[static_cast<std::size_t>(cell) * months + month]); }
 };
 
 void GlobalWorldObjects::setGlobalSnowline(float snowline)
@@ -51,7 +66,8 @@ void GlobalWorldObjects::setGlobalTreeline(float treeline)
 void GlobalWorldObjects::setSeaLevel(float level)
 {
 	seaLevel = clamp(level,1.f,0.f);
-	// There needs to be an update of all variables for cells
+	componentsValid = false;
+	// Only sets the value, updateSeaLevel in cell.hpp also updates the cells after calcHeightValues
 }
 void GlobalWorldObjects::setGlobalTemp(float temp)
 {
@@ -72,9 +88,21 @@ void GlobalWorldObjects::clearGlobals()
 	snowCells.clear();
 	treeCells.clear();
 	riverCells.clear();
+	rivers.clear();
+	riverPath.clear();
+	basins.clear();
 	lakeCells.clear();
+	lakes.clear();
+	filledHeight.clear();
 	coastCells.clear();
 	oceanCells.clear();
+	heightOrder.clear();
+	landmasses.clear();
+	waterBodies.clear();
+	componentsValid = false;
+	months = 0;
+	monthTemp.clear();
+	monthPercepitation.clear();
 	biomes.clear();
 }
 
@@ -3,6 +3,7 @@
 #include <algorithm> 
 #include <exception>
 #include "cell.hpp"
+#include "graph.hpp"
 #include "util.h"
 
 namespace vor {
@@ -61,6 +62,7 @@ namespace vor {
         std::vector<sf::Vertex> vertices;
         std::size_t vertexCount;
         vor::Grid grid_cells;
+        CellGraph graph; // Flat adjacency of the cells for the parallel kernels
         int cell_size = 50;
 
         Voronoi() {};
@@ -82,6 +84,8 @@ namespace vor {
 
         void genGrid(const int MAXWIDTH, const int MAXHEIGHT);
 
+        void genGraph();
+
         std::size_t legalize(
             std::size_t a, 
             std::vector<std::size_t>& halfedges, 
@@ -119,6 +123,95 @@ namespace vor {
 		}
         vertexGen();
 		genGrid(MAXWIDTH, MAXHEIGHT);
+        genGraph();
+    }
+
+    void Voronoi::genGraph()
+    {// Flatten the neighbor lists of the cells into one CSR array
+        graph.clear();
+        graph.offsets.resize(cells.size() + 1);
+        graph.offsets[0] = 0;
+        for (std::size_t i = 0; i < cells.size(); i++)
+        {
+            graph.offsets[i + 1] = graph.offsets[i] + static_cast<int>(cells[i].neighbors.size());
+        }
+        graph.adj.resize(graph.offsets[cells.size()]);
+        for (std::size_t i = 0; i < cells.size(); i++)
+        {
+            std::copy(cells[i].neighbors.begin(), cells[i].neighbors.end(), graph.adj.begin() + graph.offsets[i]);
+        }
+
+        // Edge lengths and directions between the sites, and the length of the polygon side the two cells share
+        graph.edgeLength.resize(graph.adj.size());
+        graph.edgeDirX.resize(graph.adj.size());
+        graph.edgeDirY.resize(graph.adj.size());
+        graph.edgeBorder.resize(graph.adj.size());
+        double length_sum = 0.0;
+        for (std::size_t i = 0; i < cells.size(); i++)
+        {
+            for (int j = graph.begin(i); j < graph.end(i); j++)
+            {
+                const int neighbor = graph.adj[j];
+                const float length = static_cast<float>(std::sqrt(dist(points[i], points[neighbor])));
+                graph.edgeLength[j] = length;
+                graph.edgeDirX[j] = length > 0.f ? (points[neighbor].x - points[i].x) / length : 0.f;
+                graph.edgeDirY[j] = length > 0.f ? (points[neighbor].y - points[i].y) / length : 0.f;
+                length_sum += length;
+
+                // Neighbors share the two circumcenters at the ends of their common side
+                int shared[2] = { -1, -1 };
+                int found = 0;
+                for (int a : cells[i].vertex)
+                {
+                    for (int b : cells[neighbor].vertex)
+                    {
+                        if (a == b && found < 2) { shared[found++] = a; }
+                    }
+                }
+                graph.edgeBorder[j] = found == 2 ? static_cast<float>(std::sqrt(dist(voronoi_points[shared[0]], voronoi_points[shared[1]]))) : 0.f;
+            }
+        }
+        graph.meanEdgeLength = graph.adj.empty() ? 0.f : static_cast<float>(length_sum / graph.adj.size());
+
+        // Polygon areas, cells on the hull have circumcenters far outside the map so they are flagged as border and get the mean area
+        sf::Vector2f min_point(std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+        sf::Vector2f max_point(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max());
+        for (std::size_t i = 0; i < points.size(); i++)
+        {
+            min_point.x = std::min(min_point.x, points[i].x);
+            min_point.y = std::min(min_point.y, points[i].y);
+            max_point.x = std::max(max_point.x, points[i].x);
+            max_point.y = std::max(max_point.y, points[i].y);
+        }
+        graph.area.assign(cells.size(), 0.f);
+        graph.border.assign(cells.size(), 0);
+        double area_sum = 0.0;
+        std::size_t interior = 0;
+        for (std::size_t i = 0; i < cells.size(); i++)
+        {
+            const std::vector<int>& vertex = cells[i].vertex;
+            bool border = vertex.size() < 3;
+            double twice_area = 0.0;
+            for (std::size_t j = 0, k = vertex.size() - 1; j < vertex.size(); k = j++)
+            {
+                const sf::Vector2f& a = voronoi_points[vertex[k]];
+                const sf::Vector2f& b = voronoi_points[vertex[j]];
+                twice_area += static_cast<double>(a.x) * b.y - static_cast<double>(b.x) * a.y;
+                border = border || b.x < min_point.x || b.x > max_point.x || b.y < min_point.y || b.y > max_point.y;
+            }
+            graph.border[i] = border;
+            if (!border)
+            {
+                graph.area[i] = static_cast<float>(std::abs(twice_area) * 0.5);
+                area_sum += graph.area[i];
+                interior++;
+            }
+        }
+        graph.meanArea = interior == 0 ? 1.f : static_cast<float>(area_sum / interior);
+        for (std::size_t i = 0; i < cells.size(); i++)
+        {
+            if (graph.border[i]) { graph.area[i] = graph.meanArea; }
+        }
     }
 
     void Voronoi::genGrid(const int MAXWIDTH, const int MAXHEIGHT)
@@ -196,6 +289,7 @@ namespace vor {
 		voronoi_points.clear();
 		vertices.clear();
 		grid_cells.clear();
+        graph.clear();
 
         vertexCount = 0;
 	}
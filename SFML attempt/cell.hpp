@@ -4,7 +4,10 @@
 #include <iostream>
 #include <cmath>
 #include <numeric>
+#include <atomic>
 #include "util.h"
+#include "graph.hpp"
+#include "noise.hpp"
 #include "Voronoi.hpp"
 #include "GlobalWorldObjects.hpp"
 #include "clustering.hpp"
@@ -21,12 +24,18 @@ public:
     float height = 0.f; // Height of the cell, 1 = 8km above sealevel 
     float rise = 0.f; // Difference in height between the highest and the lowest neighbor cell (0 to 1)
     float temp = 0.f; // Temperature of the cell (Celsius)
-    float windDir = 0.f; // Wind direction (0 to 360 degrees)
+    float windDir = 0.f; // Wind direction (0 to 360 degrees), for drawing
+    float windX = 1.f; // Wind direction as a unit vector
+    float windY = 0.f;
     float windStr = 0.f; // Wind strength (0 to 1)
+    int windBand = 0; // Wind band the cell is in (the convergence line above it), set by calcWind
+    float currentX = 0.f; // Ocean current in pixels per advection step, 0 on land and in small enclosed seas
+    float currentY = 0.f;
     float humidity = 1.f; // Humidity of the cell (0 to 1)
     float percepitation = 0.f; // Percepitation of the cell ( > 0 )
 
     int biome = 0; // Biome of the cell
+    int plate = -1; // Tectonic plate of the cell, -1 when plates are off
     std::vector<float> biome_prob; // Probabilities of each biome in the cell
 
     float distToOcean = std::numeric_limits<float>::max();
@@ -36,8 +45,11 @@ public:
 
     bool riverBool = false; // Has a river
     float riverStr = 0.f; // River strength
+    int river = -1; // Index of the river in globals.rivers
+    int basin = -1; // Drainage basin of a land cell, index in globals.basins
 
     bool lakeBool = false; // Has a lake
+    int lake = -1; // Index of the lake in globals.lakes
     bool snowBool = false; // Has snow
     bool treeBool = true; // Has trees
     
@@ -92,34 +104,72 @@ void Cell::sort_angles(const std::vector<sf::Vector2f>& points, const std::vecto
 
 void rise(std::vector<Cell>& map)
 { /* Calculate the rise by finding the tallest and shortest neighbor*/
-    // Needs to be optimized or rethought
-    float max_height = std::numeric_limits<float>::min();
-    float min_height = std::numeric_limits<float>::max();
-
-    #pragma omp parallel for num_threads(16) schedule(static)
-    for (size_t i = 0; i < map.size(); i++)
+    // min and max live inside the loop so every thread has its own, and the heights are read in place
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < static_cast<int>(map.size()); i++)
     {
-        max_height = std::numeric_limits<float>::min();
-        min_height = std::numeric_limits<float>::max();
-
-        // Cache neighbor heights
         const std::vector<int>& neighbors = map[i].neighbors;
-        std::vector<float> neighbor_heights(neighbors.size());
-        for (size_t j = 0; j < neighbors.size(); j++) {
-			neighbor_heights[j] = map[neighbors[j]].height;
-		}
+        float max_height = 0.f;
+        float min_height = std::numeric_limits<float>::max();
 
         // find min and max height
-        for (int j = 0; j < neighbors.size(); j++)
+        for (std::size_t j = 0; j < neighbors.size(); j++)
         {
-            float neighbor_height = neighbor_heights[j];
-            if (neighbor_height < min_height) min_height = neighbor_height;
-            if (neighbor_height > max_height) max_height = neighbor_height;
+            const float neighbor_height = map[neighbors[j]].height;
+            min_height = std::min(min_height, neighbor_height);
+            max_height = std::max(max_height, neighbor_height);
         }
+        map[i].rise = neighbors.empty() ? 0.f : max_height - min_height;
+    }
+}
 
-        #pragma omp critical
-        map[i].rise = max_height - min_height;
+// Rise of a single cell from a flat height array
+inline float riseOf(const CellGraph& graph, const std::vector<float>& height, int i)
+{
+    const int first = graph.begin(i);
+    const int last = graph.end(i);
+    if (first == last) { return 0.f; }
+
+    float max_height = height[graph.adj[first]];
+    float min_height = max_height;
+    for (int j = first + 1; j < last; j++)
+    {
+        const float neighbor_height = height[graph.adj[j]];
+        min_height = std::min(min_height, neighbor_height);
+        max_height = std::max(max_height, neighbor_height);
     }
+    return max_height - min_height;
+}
+
+// Recompute the rise of the listed cells only, from flat height and rise arrays
+void riseFlat(const CellGraph& graph, const std::vector<float>& height, std::vector<float>& rise, const std::vector<int>& cells)
+{
+    #pragma omp parallel for schedule(static)
+    for (int c = 0; c < static_cast<int>(cells.size()); c++)
+    {
+        rise[cells[c]] = riseOf(graph, height, cells[c]);
+    }
+}
+
+// Rise of every cell from a flat height array
+void riseFlat(const CellGraph& graph, const std::vector<float>& height, std::vector<float>& rise)
+{
+    rise.resize(height.size());
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < graph.size(); i++)
+    {
+        rise[i] = riseOf(graph, height, i);
+    }
+}
+
+// Full rise over the flat adjacency, the heights are gathered once so the inner loop only reads contiguous arrays
+void rise(std::vector<Cell>& map, const CellGraph& graph)
+{
+    std::vector<float> height;
+    std::vector<float> riseValues;
+    gatherField(map, height, &Cell::height);
+    riseFlat(graph, height, riseValues);
+    scatterField(map, riseValues, &Cell::rise);
 }
 
 // k-point smooth height generator
@@ -188,6 +238,104 @@ void random_height_gen(std::vector<Cell>& map, int k=5, float delta_max_neg=0.04
 }
 
 
+// Level-synchronous version of random_height_gen (method 3)
+// All peaks grow at once, one BFS level at a time. A cell only averages neighbors from earlier levels
+// and draws its random delta from its own id, so the result does not depend on the number of threads
+void parallel_height_gen(std::vector<Cell>& map, const CellGraph& graph, unsigned int seed, int k = 5, float delta_max_neg = 0.04, float delta_max_pos = 0.03, float prob_of_island = 0.008, float dist_from_mainland = 1.0)
+{
+    const int n = graph.size();
+    if (n == 0) { return; }
+
+    std::vector<float> height(n, 0.f);
+    std::vector<std::atomic<int>> level(n); // BFS level the cell was reached at, -1 if not reached yet
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        level[i].store(-1, std::memory_order_relaxed);
+    }
+
+    std::vector<int> frontier;
+    frontier.reserve(k);
+    for (int i = 0; i < k; i++)
+    {
+        int index = hash_u32(seed, i) % n;
+        if (level[index].load(std::memory_order_relaxed) != -1) { continue; }
+        level[index].store(0, std::memory_order_relaxed);
+        height[index] = hashRandomBetween(seed + 1, index, 0.8f, 1.0f);
+        frontier.push_back(index);
+    }
+
+    std::vector<std::vector<int>> next(thread_count()); // Per thread buffers for the next frontier
+    int depth = 0;
+    while (!frontier.empty())
+    {
+        depth++;
+        // Claim the unreached neighbors of the frontier, whichever thread wins the exchange owns the cell
+        #pragma omp parallel
+        {
+            std::vector<int>& local = next[thread_id()];
+            local.clear();
+
+            #pragma omp for schedule(static)
+            for (int f = 0; f < static_cast<int>(frontier.size()); f++)
+            {
+                const int index = frontier[f];
+                for (int j = graph.begin(index); j < graph.end(index); j++)
+                {
+                    const int neighbor = graph.adj[j];
+                    int expected = -1;
+                    if (level[neighbor].load(std::memory_order_relaxed) == -1 &&
+                        level[neighbor].compare_exchange_strong(expected, depth, std::memory_order_relaxed))
+                    {
+                        local.push_back(neighbor);
+                    }
+                }
+            }
+        }
+
+        frontier.clear();
+        for (std::size_t t = 0; t < next.size(); t++)
+        {
+            frontier.insert(frontier.end(), next[t].begin(), next[t].end());
+        }
+
+        // Neighbor average of the earlier levels plus a random delta, same rule as random_height_gen
+        #pragma omp parallel for schedule(static)
+        for (int f = 0; f < static_cast<int>(frontier.size()); f++)
+        {
+            const int index = frontier[f];
+            float height_sum = 0.f;
+            int count_values = 0;
+            for (int j = graph.begin(index); j < graph.end(index); j++)
+            {
+                const int neighbor = graph.adj[j];
+                const int neighbor_level = level[neighbor].load(std::memory_order_relaxed);
+                if (neighbor_level >= 0 && neighbor_level < depth)
+                {
+                    height_sum += height[neighbor];
+                    count_values++;
+                }
+            }
+
+            // small probability of a new island when away from the mainland, the per neighbor chance is folded into one draw
+            if (count_values > 1 && height_sum < dist_from_mainland &&
+                hashRandomBetween(seed + 2, index, 0.f, 1.f) < prob_of_island * graph.degree(index))
+            {
+                height[index] = hashRandomBetween(seed + 3, index, 0.6f, 0.9f);
+            }
+            else
+            {
+                height[index] = clamp((height_sum / count_values) + hashRandomBetween(seed + 4, index, -delta_max_neg, delta_max_pos), 1.0, 0.0);
+            }
+        }
+    }
+
+    std::vector<float> riseValues;
+    riseFlat(graph, height, riseValues); // calculate the rise of the map with the new height values
+    scatterField(map, height, &Cell::height);
+    scatterField(map, riseValues, &Cell::rise);
+}
+
 void smooth_height(std::vector<Cell>& map, float rise_threshold = 0.1, int repeats = 1, int method = 1)
 { // method 1 = Random, method 2 = Front
     {
@@ -233,6 +381,109 @@ void smooth_height(std::vector<Cell>& map, float rise_threshold = 0.1, int repea
     }
 }
 
+// Jacobi version of smooth_height (method 3)
+// Every active cell reads the heights of the previous sweep and writes into a second buffer, so the result does not
+// depend on the order or the number of threads. Only the rise of cells next to a changed height is recomputed
+void parallel_smooth_height(std::vector<Cell>& map, const CellGraph& graph, float rise_threshold = 0.1, int repeats = 1)
+{
+    const int n = graph.size();
+    if (n == 0) { return; }
+
+    std::vector<float> height;
+    std::vector<float> riseValues;
+    gatherField(map, height, &Cell::height);
+    gatherField(map, riseValues, &Cell::rise);
+    std::vector<float> next_height = height;
+
+    std::vector<char> mask(n, 0);
+    std::vector<int> stamp(n, -1); // Last repeat a cell was queued for a rise refresh
+    std::vector<int> active;
+    std::vector<int> touched;
+    std::vector<std::vector<int>> local(thread_count());
+
+    for (int r = 0; r < repeats; r++)
+    {
+        // Active set: cells above the threshold and their neighbors, each cell once
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            char on = riseValues[i] > rise_threshold;
+            for (int j = graph.begin(i); j < graph.end(i) && !on; j++)
+            {
+                on = riseValues[graph.adj[j]] > rise_threshold;
+            }
+            mask[i] = on;
+        }
+
+        #pragma omp parallel
+        {
+            std::vector<int>& list = local[thread_id()];
+            list.clear();
+            #pragma omp for schedule(static)
+            for (int i = 0; i < n; i++)
+            {
+                if (mask[i]) { list.push_back(i); }
+            }
+        }
+        active.clear();
+        for (std::size_t t = 0; t < local.size(); t++)
+        {
+            active.insert(active.end(), local[t].begin(), local[t].end());
+        }
+        if (active.empty()) { break; }
+
+        // One sweep over the active set, reading height and writing next_height
+        #pragma omp parallel for schedule(static)
+        for (int a = 0; a < static_cast<int>(active.size()); a++)
+        {
+            const int i = active[a];
+            float height_sum = 0.f;
+            for (int j = graph.begin(i); j < graph.end(i); j++)
+            {
+                height_sum += height[graph.adj[j]];
+            }
+
+            float new_height = height[i];
+            if (height_sum > 0.005) {
+                new_height = height_sum / static_cast<float>(graph.degree(i));
+            }
+            else if (height[i] > 0.5) {
+                new_height = 0.1;
+            }
+            next_height[i] = new_height;
+        }
+
+        // Commit the sweep and collect the neighbors of changed cells, their rise is the only one that moved
+        #pragma omp parallel
+        {
+            std::vector<int>& list = local[thread_id()];
+            list.clear();
+            #pragma omp for schedule(static)
+            for (int a = 0; a < static_cast<int>(active.size()); a++)
+            {
+                const int i = active[a];
+                if (next_height[i] == height[i]) { continue; }
+                height[i] = next_height[i];
+                list.insert(list.end(), graph.adj.begin() + graph.begin(i), graph.adj.begin() + graph.end(i));
+            }
+        }
+        touched.clear();
+        for (std::size_t t = 0; t < local.size(); t++)
+        {
+            for (int i : local[t])
+            {
+                if (stamp[i] == r) { continue; }
+                stamp[i] = r;
+                touched.push_back(i);
+            }
+        }
+        riseFlat(graph, height, riseValues, touched);
+    }
+
+    scatterField(map, height, &Cell::height);
+    scatterField(map, riseValues, &Cell::rise);
+}
+
 void noise_height(std::vector<Cell>& map, int n)
 {
     size_t size = map.size();
@@ -245,232 +496,252 @@ void noise_height(std::vector<Cell>& map, int n)
 	}
 }
 
-void calcHeightValues(std::vector<Cell>& map, GlobalWorldObjects& globals, float delta) // sea level, coast, treeline and snow line
+// Coherent noise height generator (method 4), fBm gives rolling land and ridged gives mountain chains
+void noise_height_gen(std::vector<Cell>& map, const CellGraph& graph, const std::vector<sf::Vector2f>& points, unsigned int seed, const NoiseSettings& settings = NoiseSettings())
 {
-    for (size_t i = 0; i < map.size(); i++)
-    {
-        map[i].height = clamp(map[i].height, 1.0, 0.0);
+    std::vector<float> height;
+    evaluateNoise(points, height, settings, seed);
 
-        if (map[i].height <= globals.seaLevel) 
-        {
-            map[i].oceanBool = true;
-            globals.oceanCells.push_back(i);
-            map[i].distToOcean = 0;
-        }
-        else { map[i].oceanBool = false; }
-        if (map[i].height <= globals.seaLevel + delta && map[i].height >= globals.seaLevel - delta) 
-        { 
-            map[i].coastBool = true;
-            globals.coastCells.push_back(i);
-        }
-        if (map[i].height >= globals.globalSnowline) 
-        {
-            map[i].snowBool = true;
-            globals.snowCells.push_back(i);
-        }
-        if (map[i].height >= globals.globalTreeline) 
-        {
-            map[i].treeBool = false;
-            globals.treeCells.push_back(i);
-        }
+    const bool ridged = settings.type == 1;
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < static_cast<int>(height.size()); i++)
+    {
+        height[i] = clamp(ridged ? height[i] : 0.5f + height[i], 1.0, 0.0); // fBm rarely leaves [-0.5, 0.5] after the octaves are normalized
     }
-}
 
-// Rivers - needs to be rewritten to be more efficient and to add river objects to the map
+    std::vector<float> riseValues;
+    riseFlat(graph, height, riseValues);
+    scatterField(map, height, &Cell::height);
+    scatterField(map, riseValues, &Cell::rise);
+}
 
-// First check if cells over snow line have neighbors below snow line and no rivers in their neighbors
-// Then start a river from that cell and add river to the neighbor and that one
-// Then add to the steepest neighbor and so on until you reach the sea or a lake
-// If you reach a lake, add the river to the lake and then continue from the lake
-// If you reach the sea, add the river to the sea and stop
-void riverIteration(std::vector<Cell>& map, GlobalWorldObjects& globals, std::vector<int>& stack, int start)
+// One pass replacement for noise_height, n keeps the same meaning so the amplitude matches n white noise passes
+void noise_height(std::vector<Cell>& map, const std::vector<sf::Vector2f>& points, int n, unsigned int seed)
 {
-    std::vector<std::pair<int,float>> HeightDiff;
-    HeightDiff.reserve(map[start].neighbors.size());
-    for (int i = 0; i < map[start].neighbors.size(); i++)
+    NoiseSettings settings;
+    settings.octaves = 3;
+    settings.frequency = 0.02f;
+
+    std::vector<float> value;
+    evaluateNoise(points, value, settings, seed);
+
+    const float amplitude = 0.005f * n;
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < static_cast<int>(map.size()); i++)
     {
-        HeightDiff.push_back({ map[start].neighbors[i], map[start].height - map[map[start].neighbors[i]].height });
+        map[i].height = map[i].height + amplitude * value[i];
     }
-    std::sort(HeightDiff.begin(), HeightDiff.end(), [](const std::pair<int, float>& a, const std::pair<int, float>& b) { return a.second < b.second; });
+}
 
-    int order = 1;
+constexpr int SEA_LEVEL_BINS = 4096; // Histogram bins over the height range for seaLevelFromLandFraction
 
-    if (HeightDiff[HeightDiff.size() - 1].second < 0) // ITs too happy to make lakes, it needs more rivers.
-    { // if no neighbor is found to have a lower height, either the river ends or it should generate a lake
-      // Determined by the sum of nearby differences
-        // TODO: This needs to be tuned and fixed
-        float sum = 0;
-        for (const auto& pair : HeightDiff) {
-            sum += std::abs(pair.second);
-        }
-        if (sum <= 0.1)
+// Sea level that leaves land_fraction of the cells above it (height percentile)
+// Every thread fills its own histogram, the merged histogram picks the bin and only that bin is sorted
+float seaLevelFromLandFraction(const std::vector<Cell>& map, float land_fraction)
+{
+    const int n = static_cast<int>(map.size());
+    if (n == 0) { return 0.5f; }
+    const int ocean_count = n - static_cast<int>(std::round(clamp(land_fraction, 1.f, 0.f) * n));
+    if (ocean_count <= 0) { return 0.f; }
+    if (ocean_count >= n) { return 1.f; }
+
+    std::vector<int> histogram(SEA_LEVEL_BINS * thread_count(), 0);
+    #pragma omp parallel
+    {
+        int* local = &histogram[SEA_LEVEL_BINS * thread_id()];
+        #pragma omp for schedule(static)
+        for (int i = 0; i < n; i++)
         {
-            for (int i = 0; i < map[start].neighbors.size(); i++)
-            {
-                map[map[start].neighbors[i]].lakeBool = true;
-            }
+            const float height = clamp(map[i].height, 1.f, 0.f);
+            local[std::min(static_cast<int>(height * SEA_LEVEL_BINS), SEA_LEVEL_BINS - 1)]++;
         }
     }
-    else
+    for (int t = 1; t < thread_count(); t++)
     {
-        if (map[HeightDiff[HeightDiff.size() - order].first].snowBool == true)
-        {
-            return;
-        }
-        else if (map[HeightDiff[HeightDiff.size() - order].first].oceanBool == true)
+        for (int b = 0; b < SEA_LEVEL_BINS; b++)
         {
-            return;
-        }
-        
-        else if (map[HeightDiff[HeightDiff.size() - order].first].riverBool == true)
-        {// pick a neighbor whose neighbor's neighbors are not rivers
-            std::vector<int> possibleNeighbors;
-            for (int i = 0; i < map[start].neighbors.size(); i++)
-            {
-                if (map[map[start].neighbors[i]].riverBool == false) 
-                {
-                    int countRiverNeighbors = 0;
-                    for (int j = 0; j < map[map[start].neighbors[i]].neighbors.size(); j++)
-                    {
-                        if (map[map[map[start].neighbors[i]].neighbors[j]].riverBool) { countRiverNeighbors += 1; }
-                    }
-                    if (countRiverNeighbors <= 1)
-                    {
-                        possibleNeighbors.push_back(map[start].neighbors[i]);
-                    }
-                }
-            }
-            if (possibleNeighbors.size() > 0)
-            {
-                std::sort(possibleNeighbors.begin(), possibleNeighbors.end());
-				map[possibleNeighbors[possibleNeighbors.size() - 1]].riverBool = true;
-				globals.riverCells.push_back(possibleNeighbors[possibleNeighbors.size() - 1]);
-				map[possibleNeighbors[possibleNeighbors.size() - 1]].riverStr = map[start].riverStr; //- RandomBetween(0.001, 0.003);
-				riverIteration(map, globals, stack, possibleNeighbors[possibleNeighbors.size() - 1]);
-            }
-            else {
-                
-                return;
-            }
+            histogram[b] += histogram[SEA_LEVEL_BINS * t + b];
         }
     }
 
-    map[HeightDiff[HeightDiff.size() - order].first].riverBool = true;
-    globals.riverCells.push_back(HeightDiff[HeightDiff.size() - order].first);
-    map[HeightDiff[HeightDiff.size() - order].first].riverStr = map[start].riverStr; //- RandomBetween(0.001, 0.003);
-    riverIteration(map, globals, stack, HeightDiff[HeightDiff.size() - order].first);
-    // FLow strenght calculate here
+    // The ocean_count-th lowest height lies in the first bin where the running count reaches it
+    int bin = 0;
+    int below = 0;
+    while (below + histogram[bin] < ocean_count)
+    {
+        below += histogram[bin];
+        bin++;
+    }
 
+    std::vector<float> in_bin;
+    in_bin.reserve(histogram[bin]);
+    for (int i = 0; i < n; i++)
+    {
+        const float height = clamp(map[i].height, 1.f, 0.f);
+        if (std::min(static_cast<int>(height * SEA_LEVEL_BINS), SEA_LEVEL_BINS - 1) == bin) { in_bin.push_back(height); }
+    }
+    std::nth_element(in_bin.begin(), in_bin.begin() + (ocean_count - below - 1), in_bin.end());
+    return in_bin[ocean_count - below - 1];
 }
 
-void calcRiverStart(std::vector<Cell>& map, GlobalWorldObjects& globals)
+// Cells of heightOrder up to this one are at or below the height (count of cells with height <= level)
+int heightRank(const std::vector<Cell>& map, const std::vector<int>& heightOrder, float level)
 {
-    // copy vector 1 to vector 2
-   
-    std::vector<int> stack;
-    stack.reserve(globals.snowCells.size());
-    for (int i = 0; i < globals.snowCells.size(); i++)
-    {
-        int countNonSnow = 0;
+    return static_cast<int>(std::upper_bound(heightOrder.begin(), heightOrder.end(), level,
+        [&map](float value, int cell) { return value < map[cell].height; }) - heightOrder.begin());
+}
+
+// Cells of heightOrder before this one are below the height
+int heightRankBelow(const std::vector<Cell>& map, const std::vector<int>& heightOrder, float level)
+{
+    return static_cast<int>(std::lower_bound(heightOrder.begin(), heightOrder.end(), level,
+        [&map](int cell, float value) { return map[cell].height < value; }) - heightOrder.begin());
+}
+
+// Bits of the per cell flags in calcHeightValues
+enum HeightFlags : unsigned char { HEIGHT_OCEAN = 1, HEIGHT_COAST = 2, HEIGHT_SNOW = 4, HEIGHT_TREELESS = 8 };
 
-        for (int j = 0; j < map[globals.snowCells[i]].neighbors.size(); j++)
+// Sea level, coast, treeline and snow line
+// The cells are split in one chunk per thread: every chunk flags and counts its cells, an exclusive prefix sum over the
+// chunk counts gives each chunk its place in the lists, and a second pass writes the indices, so the lists are exact sized
+void calcHeightValues(std::vector<Cell>& map, GlobalWorldObjects& globals, float delta)
+{
+    const int n = static_cast<int>(map.size());
+    const int chunks = thread_count();
+    const float sea_level = globals.seaLevel;
+    const float snowline = globals.globalSnowline;
+    const float treeline = globals.globalTreeline;
+    std::vector<unsigned char> flags(n);
+    std::vector<int> counts(4 * (chunks + 1), 0); // counts[4 * c + list], shifted by one chunk for the prefix sum
+
+    #pragma omp parallel for schedule(static)
+    for (int c = 0; c < chunks; c++)
+    {
+        const int first = static_cast<int>(static_cast<long long>(n) * c / chunks);
+        const int last = static_cast<int>(static_cast<long long>(n) * (c + 1) / chunks);
+        int* count = &counts[4 * (c + 1)];
+        for (int i = first; i < last; i++)
         {
-            if (!map[map[globals.snowCells[i]].neighbors[j]].snowBool)
+            Cell& cell = map[i];
+            cell.height = clamp(cell.height, 1.f, 0.f);
+            unsigned char flag = 0;
+            if (cell.height <= sea_level) { flag |= HEIGHT_OCEAN; }
+            if (cell.height <= sea_level + delta && cell.height >= sea_level - delta) { flag |= HEIGHT_COAST; }
+            if (cell.height >= snowline) { flag |= HEIGHT_SNOW; }
+            if (cell.height >= treeline) { flag |= HEIGHT_TREELESS; }
+            flags[i] = flag;
+
+            cell.oceanBool = (flag & HEIGHT_OCEAN) != 0;
+            if (cell.oceanBool) { cell.distToOcean = 0; }
+            cell.coastBool = (flag & HEIGHT_COAST) != 0;
+            cell.snowBool = (flag & HEIGHT_SNOW) != 0;
+            cell.treeBool = (flag & HEIGHT_TREELESS) == 0;
+            for (int list = 0; list < 4; list++)
             {
-                countNonSnow = countNonSnow + 1;
+                count[list] += (flag >> list) & 1;
             }
         }
-        if (countNonSnow >= 2) 
-        {
-            stack.push_back(globals.snowCells[i]);
-        }
     }
 
-    while (!stack.empty())
+    for (int c = 0; c < chunks; c++)
     {
-        int count = 0; 
-        int idx = pop_random_i(stack);
-        if (map[idx].riverBool == true)
-        {
-            continue;
-        }
-        if (map[idx].lakeBool == true)
+        for (int list = 0; list < 4; list++)
         {
-            continue;
+            counts[4 * (c + 1) + list] += counts[4 * c + list];
         }
-        for (int i = 0; i < map[idx].neighbors.size(); i++)
+    }
+    std::vector<int>* lists[4] = { &globals.oceanCells, &globals.coastCells, &globals.snowCells, &globals.treeCells };
+    for (int list = 0; list < 4; list++)
+    {
+        lists[list]->resize(counts[4 * chunks + list]);
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (int c = 0; c < chunks; c++)
+    {
+        const int first = static_cast<int>(static_cast<long long>(n) * c / chunks);
+        const int last = static_cast<int>(static_cast<long long>(n) * (c + 1) / chunks);
+        int offset[4] = { counts[4 * c], counts[4 * c + 1], counts[4 * c + 2], counts[4 * c + 3] };
+        for (int i = first; i < last; i++)
         {
-            if (map[map[idx].neighbors[i]].riverBool == true)
+            for (int list = 0; list < 4; list++)
             {
-                count++;
+                if ((flags[i] >> list) & 1) { (*lists[list])[offset[list]++] = i; }
             }
         }
-        if (count >= 1)
-        {
-			continue;
-		}
-        if (RandomBetween(0.0, 1.0) > 0.4)
-        {
-            globals.riverCells.push_back(idx);
-            map[idx].riverBool = true;
-            map[idx].riverStr = RandomBetween(0.99, 1.0); // has to be based on temperature and percepitation as well
-            riverIteration(map, globals, stack, idx);
-        }
     }
+
+    // The sorted index for updateSeaLevel and the components are built the first time they are needed
+    globals.coastDelta = delta;
+    globals.heightOrder.clear();
+    globals.componentsValid = false;
 }
 
+constexpr int CLIMATE_LANES = 8; // Cells per block in the climate kernels, fixed width loops the compiler turns into SIMD
+
+// Temperature from latitude and altitude over flat arrays, blocks of 8 cells are split over the threads like evaluateNoise
+// Humidity and distance from the sea still need implementation, ocean currents move the heat after it (calcCurrents)
 void calcTemp(std::vector<Cell>& map, GlobalWorldObjects& globals, const std::vector<sf::Vector2f>& points, const int MAXHEIGHT)
 {
-    for (int i = 0; i < map.size(); i++)
-    {   // Take distance to equator and get the distance 
-        // Add an altitute modifier
-        // Ocean Currents (needs implementation)
-        // Humidity, will be loop (needs implementation)
-        // Distance from sea (needs a function that is quick)
-        float temp = 0.f;
-
-        // Latitute
-        float dist = std::abs(points[i].y - MAXHEIGHT/2);
-        float c = 0.0015;
-        float b = 5;
-        float a = 5;
-        temp += 1.5 * globals.globalTempAvg - globals.globalTempAvg * (a * expf(-b * expf(-c * dist))); // Gompertz function
-        // Altitute
-        if (map[i].height >= globals.seaLevel)
-        {
-            temp += map[i].height * (-50);
+    const int n = static_cast<int>(map.size());
+    if (n == 0) { return; }
+    const int blocks = (n + CLIMATE_LANES - 1) / CLIMATE_LANES;
+    std::vector<float> height;
+    std::vector<float> temp(n);
+    gatherField(map, height, &Cell::height);
+
+    const float average = globals.globalTempAvg;
+    const float sea_level = globals.seaLevel;
+    const float equator = static_cast<float>(MAXHEIGHT / 2);
+    #pragma omp parallel for schedule(static)
+    for (int b = 0; b < blocks; b++)
+    {
+        float latitude[CLIMATE_LANES];
+        float h[CLIMATE_LANES];
+        float value[CLIMATE_LANES];
+        const int first = b * CLIMATE_LANES;
+        for (int l = 0; l < CLIMATE_LANES; l++)
+        {
+            const int i = std::min(first + l, n - 1);
+            latitude[l] = std::abs(points[i].y - equator);
+            h[l] = height[i];
         }
-        else
+        for (int l = 0; l < CLIMATE_LANES; l++)
+        {
+            // Latitude, Gompertz function of the distance to the equator
+            const float gompertz = 5.f * fast_exp(-5.f * fast_exp(-0.0015f * latitude[l]));
+            // Altitude, the ocean gets colder with depth
+            const float altitude = h[l] >= sea_level ? h[l] : 1.f - h[l];
+            value[l] = 1.5f * average - average * gompertz - 50.f * altitude;
+        }
+        for (int l = 0; l < CLIMATE_LANES && first + l < n; l++)
         {
-            temp += (1 - map[i].height) * (-50);
+            temp[first + l] = value[l];
         }
-        map[i].temp = temp;
     }
+    scatterField(map, temp, &Cell::temp);
 }
 
-void smoothTemps(std::vector<Cell>& map,int smoothTimes)
+void smoothTemps(std::vector<Cell>& map, const CellGraph& graph, int smoothTimes)
 {
-    for (int j = 0; j < smoothTimes; j++)
-    {
-        for (int i = 0; i < map.size(); i++)
-        {
-            float temp = 0;
-            for (int j = 0; j < map[i].neighbors.size(); j++)
-            {
-                temp += map[map[i].neighbors[j]].temp;
-            }
-            map[i].temp = temp / map[i].neighbors.size();
-        }
-    }
+    smoothFields(map, graph, { &Cell::temp }, smoothTimes);
 }
 
 
-void calcPercepitation(std::vector<Cell>& map, const std::vector<sf::Vector2f>& points, GlobalWorldObjects& globals,int runs = 1)
+void calcPercepitation(std::vector<Cell>& map, const CellGraph& graph, GlobalWorldObjects& globals,int runs = 1)
 { // Humidity, temperature, distance from sea, altitude, ocean currents (warmer=more), wind
+    // Falloff with the distance from the ocean only depends on the cell, so it is computed once instead of for every edge
+    // distToOcean is a path length in pixels, 0.03 keeps the falloff from the coast about as wide as it was with squared distances
+    std::vector<float> coastFactor(map.size());
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < static_cast<int>(map.size()); i++)
+    {
+        coastFactor[i] = 1 - std::exp(-1 / (0.03f * map[i].distToOcean));
+    }
+
     for (int j = 0; j < runs; j++)
     {
         // NEEEEds oceans to be seperately done before, then do land cells. 
-        // There seems to be a problem with direction of the wind.
         Queue<int> queue;
         for (int i = 0; i < globals.oceanCells.size(); i++)
         {
@@ -486,26 +757,26 @@ void calcPercepitation(std::vector<Cell>& map, const std::vector<sf::Vector2f>&
                 // Really just based on Azgaar.. Should be changed to something I get.
                 map[idx].percepitation = ((700 * (map[idx].temp)) / 50 + 125) / (80 - map[idx].temp);
             }
-            for (int i = 0; i < map[idx].neighbors.size(); i++)
+            const float windX = map[idx].windX;
+            const float windY = map[idx].windY;
+            for (int e = graph.begin(idx); e < graph.end(idx); e++)
             { // Get the wind direction and add fragments of the percepitation to the neighbors based on the wind direction and strength
-                int neighbor = map[idx].neighbors[i];
+                int neighbor = graph.adj[e];
                 if (visited[neighbor] == false)
                 {
-                    float dirOfNeighbor = atan2(points[neighbor].y - points[idx].y, points[neighbor].x - points[idx].x);
-                    // Assign similarity of direction to the wind direction
-                    float absSimAngle = std::abs(std::fmod(dirOfNeighbor - map[idx].windDir, 2 * PI) - radians(map[idx].windDir));
-                    float simDir = std::fmin(absSimAngle, std::abs(2 * PI - absSimAngle)) / PI;
+                    // Similarity of the edge to the wind direction, 1 straight downwind and 0 straight upwind
+                    float simDir = 0.5f * (1 + graph.edgeDirX[e] * windX + graph.edgeDirY[e] * windY);
 
                     if (map[neighbor].coastBool == true)
                     { // If the neighbor is a coast cell, add a larger amount of percepitation 
-                        map[neighbor].percepitation += 1 / 5 * map[idx].percepitation * simDir * map[idx].windStr * (1 - std::exp(-1 / (0.002 * map[neighbor].distToOcean)));
+                        map[neighbor].percepitation += 1 / 5 * map[idx].percepitation * simDir * map[idx].windStr * coastFactor[neighbor];
                         queue.push(neighbor);
 
                     }
                     else
                     { // If the neighbor is not a coast cell, add a smaller amount of percepitation, but also add altitute modifier
                         float heightPercep = map[neighbor].height < 0.8f ? map[neighbor].height * 3 : map[neighbor].height * (1);
-                        map[neighbor].percepitation += ((7 * (map[idx].temp)) / 50 + 60) / (80 - map[idx].temp) + 1 * (map[idx].percepitation * simDir * map[idx].windStr + heightPercep) * (1 - std::exp(-1 / (0.002 * map[neighbor].distToOcean)));
+                        map[neighbor].percepitation += ((7 * (map[idx].temp)) / 50 + 60) / (80 - map[idx].temp) + 1 * (map[idx].percepitation * simDir * map[idx].windStr + heightPercep) * coastFactor[neighbor];
                         queue.push(neighbor);
                     }
                     map[neighbor].percepitation = clamp(map[neighbor].percepitation, 100.f, 0.f);
@@ -516,34 +787,311 @@ void calcPercepitation(std::vector<Cell>& map, const std::vector<sf::Vector2f>&
     }
 }
 
-void smoothPercepitation(std::vector<Cell>& map, int smoothTimes)
+struct PercepitationSettings
+{
+    int sweeps = 2; // Passes in upwind order, the second one repairs the cells where a wind cycle was cut
+    float rainRate = 0.02f; // Share of the carried moisture that falls on flat land in every cell
+    float orographic = 2.f; // Extra share per unit of height the air climbs into the cell
+    float edgeMoisture = 0.25f; // Moisture of air entering land with nothing upwind (map edge, diverging winds), relative to the ocean
+};
+
+// The edge from cell i to the neighbor at e points downwind, by the mean wind of the two cells
+// The test is antisymmetric so a pair of cells is never ordered both ways, exact ties go to the lower id
+inline bool downwind(const std::vector<Cell>& map, const CellGraph& graph, int i, int e)
+{
+    const int neighbor = graph.adj[e];
+    const float along = graph.edgeDirX[e] * (map[i].windX + map[neighbor].windX) + graph.edgeDirY[e] * (map[i].windY + map[neighbor].windY);
+    return along > 0.f || (along == 0.f && i < neighbor);
+}
+
+// Moisture an ocean cell gives to the air, warm water evaporates more
+inline float oceanMoisture(float temp)
+{
+    return 100.f * clamp((temp + 10.f) / 40.f, 1.f, 0.05f);
+}
+
+// Cells of every wind band in upwind order, topologically sorted (Kahn) over the edges the wind blows along inside the band
+// Curling wind can still close a cycle, then the waiting cell furthest upwind along the band's wind is released
+// Bands do not share edges, so each band is sorted by one thread and the order is the same for any thread count
+void upwindOrder(const std::vector<Cell>& map, const CellGraph& graph, const std::vector<sf::Vector2f>& points, const GlobalWorldObjects& globals, std::vector<int>& order, std::vector<int>& bandStart)
 {
-    for (int j = 0; j < smoothTimes; j++)
+    const int n = graph.size();
+    const int bands = std::max(1, static_cast<int>(globals.convergenceLines.size()));
+
+    // Counting sort of the cells by band
+    bandStart.assign(bands + 1, 0);
+    for (int i = 0; i < n; i++) { bandStart[map[i].windBand + 1]++; }
+    for (int b = 0; b < bands; b++) { bandStart[b + 1] += bandStart[b]; }
+    std::vector<int> members(n);
+    std::vector<int> fill(bandStart.begin(), bandStart.end() - 1);
+    for (int i = 0; i < n; i++) { members[fill[map[i].windBand]++] = i; }
+
+    order.resize(n);
+    std::vector<int> waiting(n, 0); // Upwind neighbors not placed yet
+    std::vector<char> placed(n, 0);
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int b = 0; b < bands; b++)
     {
-        for (int i = 0; i < map.size(); i++)
+        const int first = bandStart[b];
+        const int last = bandStart[b + 1];
+        std::vector<int> ready;
+        for (int k = first; k < last; k++)
         {
-            float percepitation = 0;
-            for (int j = 0; j < map[i].neighbors.size(); j++)
+            const int i = members[k];
+            for (int e = graph.begin(i); e < graph.end(i); e++)
             {
-                percepitation += map[map[i].neighbors[j]].percepitation;
+                const int neighbor = graph.adj[e];
+                if (map[neighbor].windBand == b && downwind(map, graph, i, e)) { waiting[neighbor]++; }
+            }
+        }
+        for (int k = first; k < last; k++)
+        {
+            if (waiting[members[k]] == 0) { ready.push_back(members[k]); }
+        }
+
+        // Cells sorted along the band's wind, only needed once a cycle is hit
+        std::vector<int> upwind;
+        std::size_t next_upwind = 0;
+        std::size_t head = 0;
+        int out = first;
+        while (out < last)
+        {
+            if (head == ready.size())
+            { // Every waiting cell is on a cycle, release the one furthest upwind
+                if (upwind.empty())
+                {
+                    const float direction = globals.windDirection.empty() ? 0.f : radians(globals.windDirection[b]);
+                    const float wx = std::cos(direction);
+                    const float wy = std::sin(direction);
+                    upwind.assign(members.begin() + first, members.begin() + last);
+                    std::sort(upwind.begin(), upwind.end(), [&points, wx, wy](int a, int c)
+                        { return points[a].x * wx + points[a].y * wy < points[c].x * wx + points[c].y * wy; });
+                }
+                while (placed[upwind[next_upwind]]) { next_upwind++; }
+                ready.push_back(upwind[next_upwind]);
+            }
+            const int i = ready[head++];
+            if (placed[i]) { continue; }
+            placed[i] = 1;
+            order[out++] = i;
+            for (int e = graph.begin(i); e < graph.end(i); e++)
+            {
+                const int neighbor = graph.adj[e];
+                if (map[neighbor].windBand != b || placed[neighbor] || !downwind(map, graph, i, e)) { continue; }
+                if (--waiting[neighbor] == 0) { ready.push_back(neighbor); }
             }
-            map[i].percepitation = percepitation / map[i].neighbors.size();
         }
     }
 }
 
-void calcHumid(std::vector<Cell>& map)
+// Moisture carried along the wind in upwind order, in one or two sweeps instead of a random flood
+// Every cell takes in the moisture of its upwind neighbors weighted by the flux through the shared side,
+// oceans load the air up, land rains out a share of it and air climbing over higher ground rains out more,
+// so the lee side of mountains ends up dry (rain shadow)
+// Air does not cross between wind bands, where bands meet the winds either converge or diverge anyway
+void calcPercepitationSweep(std::vector<Cell>& map, const CellGraph& graph, const std::vector<sf::Vector2f>& points, GlobalWorldObjects& globals, const PercepitationSettings& settings = PercepitationSettings())
 {
-    for (int i = 0; i < map.size(); i++)
+    const int n = graph.size();
+    if (n == 0) { return; }
+    std::vector<int> order;
+    std::vector<int> bandStart;
+    upwindOrder(map, graph, points, globals, order, bandStart);
+    const int bands = static_cast<int>(bandStart.size()) - 1;
+
+    std::vector<float> moisture(n, 0.f); // Moisture of the air leaving every cell
+    for (int s = 0; s < std::max(1, settings.sweeps); s++)
     {
-        // smooth function to get the humidity from the percepitation, temperature // Needs work and wind.
-        float humid = 1 + exp(-0.2 * (std::logf(map[i].percepitation) + std::logf(std::abs(map[i].temp))));
-        if (humid == 0.f || isinf(humid) || isnan(humid))
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (int b = 0; b < bands; b++)
         {
-            humid = 0.5;
+            for (int k = bandStart[b]; k < bandStart[b + 1]; k++)
+            {
+                const int i = order[k];
+                Cell& cell = map[i];
+                if (cell.oceanBool)
+                {
+                    // Really just based on Azgaar.. Should be changed to something I get.
+                    cell.percepitation = ((700 * (cell.temp)) / 50 + 125) / (80 - cell.temp);
+                    moisture[i] = oceanMoisture(cell.temp);
+                    continue;
+                }
+
+                float flux = 0.f;
+                float incoming = 0.f;
+                float upwind_height = 0.f;
+                for (int e = graph.begin(i); e < graph.end(i); e++)
+                {
+                    const int neighbor = graph.adj[e];
+                    if (map[neighbor].windBand != b || downwind(map, graph, i, e)) { continue; }
+                    // Wind blowing in through the shared side, the direction of the edge points against it
+                    const float w = -(graph.edgeDirX[e] * (cell.windX + map[neighbor].windX) + graph.edgeDirY[e] * (cell.windY + map[neighbor].windY)) * graph.edgeBorder[e];
+                    flux += w;
+                    incoming += w * moisture[neighbor];
+                    upwind_height += w * map[neighbor].height;
+                }
+
+                float air;
+                float climb = 0.f;
+                if (flux > 0.f)
+                {
+                    air = incoming / flux;
+                    climb = std::max(0.f, cell.height - upwind_height / flux);
+                }
+                else
+                {
+                    air = settings.edgeMoisture * oceanMoisture(cell.temp);
+                }
+
+                const float share = clamp(settings.rainRate + settings.orographic * climb, 1.f, 0.f);
+                const float rain = air * share;
+                moisture[i] = air - rain;
+                if (cell.lakeBool) { moisture[i] = std::max(moisture[i], 0.5f * oceanMoisture(cell.temp)); } // Lakes load the air up a bit again
+                cell.percepitation = clamp(rain / settings.rainRate, 100.f, 0.f);
+            }
         }
+    }
+}
+
+void smoothPercepitation(std::vector<Cell>& map, const CellGraph& graph, int smoothTimes)
+{
+    smoothFields(map, graph, { &Cell::percepitation }, smoothTimes);
+}
 
-        map[i].humidity = 1 / humid;
+struct SeasonSettings
+{
+    int months = 12; // 12 for monthly values, 2 for summer and winter
+    float tilt = 0.08f; // How far the thermal equator moves north and south over the year (fraction of the map height)
+    float oceanDamping = 0.4f; // Share of the land's seasonal swing the ocean gets
+    float rainSensitivity = 0.04f; // Change in percepitation per degree a month is warmer than the year
+};
+
+// Temperature and percepitation for every month in one pass over the cells, all months of a cell are done together
+// The thermal equator follows the sun, a month is the yearly value plus the change of the latitude term in calcTemp,
+// the ocean swings less than land and warmer months rain more
+// Results go to globals.monthTemp and globals.monthPercepitation as half floats, month 0 has the sun furthest south
+void calcSeasons(const std::vector<Cell>& map, GlobalWorldObjects& globals, const std::vector<sf::Vector2f>& points, const int MAXHEIGHT, const SeasonSettings& settings = SeasonSettings())
+{
+    const int n = static_cast<int>(map.size());
+    const int months = std::max(1, settings.months);
+    globals.months = months;
+    globals.monthTemp.resize(static_cast<std::size_t>(n) * months);
+    globals.monthPercepitation.resize(static_cast<std::size_t>(n) * months);
+    if (n == 0) { return; }
+
+    const float average = globals.globalTempAvg;
+    const float equator = static_cast<float>(MAXHEIGHT / 2);
+    std::vector<float> shift(months);
+    for (int m = 0; m < months; m++)
+    {
+        shift[m] = settings.tilt * MAXHEIGHT * std::cos(2.f * PI * (m + 0.5f) / months);
+    }
+
+    const int blocks = (n + CLIMATE_LANES - 1) / CLIMATE_LANES;
+    #pragma omp parallel for schedule(static)
+    for (int b = 0; b < blocks; b++)
+    {
+        float y[CLIMATE_LANES];
+        float temp[CLIMATE_LANES];
+        float rain[CLIMATE_LANES];
+        float swing[CLIMATE_LANES];
+        float year[CLIMATE_LANES];
+        float value[CLIMATE_LANES];
+        const int first = b * CLIMATE_LANES;
+        for (int l = 0; l < CLIMATE_LANES; l++)
+        {
+            const int i = std::min(first + l, n - 1);
+            y[l] = points[i].y;
+            temp[l] = map[i].temp;
+            rain[l] = map[i].percepitation;
+            swing[l] = map[i].oceanBool ? settings.oceanDamping : 1.f;
+            year[l] = 5.f * fast_exp(-5.f * fast_exp(-0.0015f * std::abs(y[l] - equator)));
+        }
+        for (int m = 0; m < months; m++)
+        {
+            for (int l = 0; l < CLIMATE_LANES; l++)
+            {
+                const float gompertz = 5.f * fast_exp(-5.f * fast_exp(-0.0015f * std::abs(y[l] - equator - shift[m])));
+                value[l] = temp[l] - swing[l] * average * (gompertz - year[l]);
+            }
+            for (int l = 0; l < CLIMATE_LANES && first + l < n; l++)
+            {
+                const std::size_t at = static_cast<std::size_t>(first + l) * months + m;
+                globals.monthTemp[at] = float_to_half(value[l]);
+                globals.monthPercepitation[at] = float_to_half(rain[l] * clamp(1.f + settings.rainSensitivity * (value[l] - temp[l]), 2.f, 0.1f));
+            }
+        }
+    }
+}
+
+enum ClimateFlags { CLIMATE_SNOW = 1, CLIMATE_ICE = 2 };
+
+struct ClimateSettings
+{
+    float snowTemp = -3.f; // Land colder than this is snow covered when it gets enough percepitation
+    float snowPercepitation = 2.f;
+    float iceTemp = -10.f; // Colder than this freezes over, sea ice on the ocean and ice caps on land
+};
+
+// Humidity, snow and ice in one pass over flat arrays after the percepitation, in blocks of 8 cells like calcTemp
+// Snow from the snowline in calcHeightValues is kept, globals.snowCells is rebuilt with the cold cells added
+void calcClimate(std::vector<Cell>& map, GlobalWorldObjects& globals, const ClimateSettings& settings = ClimateSettings())
+{
+    const int n = static_cast<int>(map.size());
+    if (n == 0) { return; }
+    const int blocks = (n + CLIMATE_LANES - 1) / CLIMATE_LANES;
+    std::vector<float> temp;
+    std::vector<float> percepitation;
+    std::vector<float> humidity(n);
+    std::vector<unsigned char> flags(n);
+    gatherField(map, temp, &Cell::temp);
+    gatherField(map, percepitation, &Cell::percepitation);
+
+    #pragma omp parallel for schedule(static)
+    for (int b = 0; b < blocks; b++)
+    {
+        float t[CLIMATE_LANES];
+        float p[CLIMATE_LANES];
+        float land[CLIMATE_LANES];
+        float h[CLIMATE_LANES];
+        unsigned char flag[CLIMATE_LANES];
+        const int first = b * CLIMATE_LANES;
+        for (int l = 0; l < CLIMATE_LANES; l++)
+        {
+            const int i = std::min(first + l, n - 1);
+            t[l] = temp[i];
+            p[l] = percepitation[i];
+            land[l] = map[i].oceanBool ? 0.f : 1.f;
+        }
+        for (int l = 0; l < CLIMATE_LANES; l++)
+        {
+            // smooth function to get the humidity from the percepitation, temperature // Needs work and wind.
+            // 1 + exp(-0.2 * (log(p) + log|t|)), with the old fallback when either is 0
+            const float product = p[l] * std::abs(t[l]);
+            const float humid = product > 0.f && product < 3.0e38f ? 1.f + fast_exp(-0.2f * fast_log(product)) : 0.5f;
+            h[l] = 1.f / humid;
+
+            const bool snow = land[l] > 0.f && t[l] <= settings.snowTemp && p[l] >= settings.snowPercepitation;
+            const bool ice = t[l] <= settings.iceTemp;
+            flag[l] = static_cast<unsigned char>((snow ? CLIMATE_SNOW : 0) | (ice ? CLIMATE_ICE : 0));
+        }
+        for (int l = 0; l < CLIMATE_LANES && first + l < n; l++)
+        {
+            humidity[first + l] = h[l];
+            flags[first + l] = flag[l];
+        }
+    }
+
+    scatterField(map, humidity, &Cell::humidity);
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        if (flags[i] & CLIMATE_SNOW) { map[i].snowBool = true; }
+        map[i].iceBool = (flags[i] & CLIMATE_ICE) != 0;
+    }
+    globals.snowCells.clear();
+    for (int i = 0; i < n; i++)
+    {
+        if (map[i].snowBool) { globals.snowCells.push_back(i); }
     }
 }
 
@@ -571,7 +1119,7 @@ void removeBiome(int id, GlobalWorldObjects& globals, std::vector<Cell>& map)
     }
 }
 
-void calcBiome(std::vector<Cell>& map, GlobalWorldObjects& globals, int kmeans_max_iter=5, int method = 1, float prob_smoothing = 0.5f) {
+void calcBiome(std::vector<Cell>& map, const CellGraph& graph, GlobalWorldObjects& globals, int kmeans_max_iter=5, int method = 1, float prob_smoothing = 0.5f) {
     if (globals.biomes.size() == 0) {
 		globals.generateBiomes();
 	}
@@ -657,23 +1205,26 @@ void calcBiome(std::vector<Cell>& map, GlobalWorldObjects& globals, int kmeans_m
 		ocean_bool.push_back(globals.biomes[i].isOcean);
 	}
 
-    for (std::size_t i = 0; i < map.size(); i++)
+    // Own probabilities plus prob_smoothing times the neighbor average, the scale does not matter as they are normalized after
+    const int n_biomes = static_cast<int>(globals.biomes.size());
+    std::vector<float> probs(map.size() * n_biomes, 0.f);
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < static_cast<int>(map.size()); i++)
     {
-		std::vector<int> neighbors = map[i].neighbors;
-		std::vector<float> probs(globals.biomes.size(),0.f);
-        for (std::size_t j = 0; j < neighbors.size(); j++)
+        for (int k = 0; k < n_biomes && k < static_cast<int>(map[i].biome_prob.size()); k++)
         {
-			std::vector<float> neighbor_probs = map[neighbors[j]].biome_prob;
-            for (std::size_t k = 0; k < probs.size(); k++)
-            {
-				probs[k] += neighbor_probs[k];
-			}
-		}
-        // Take the average of the neighbors and weight them by smoothing factor
-        probs = scalarMultiplication(probs, prob_smoothing / neighbors.size());
+            probs[static_cast<std::size_t>(i) * n_biomes + k] = map[i].biome_prob[k];
+        }
+    }
+    SmoothSettings smoothSettings;
+    smoothSettings.self = 1.f / (1.f + prob_smoothing);
+    smoothGraph(graph, probs, n_biomes, 1, smoothSettings);
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < static_cast<int>(map.size()); i++)
+    {
+        map[i].biome_prob.assign(probs.begin() + static_cast<std::size_t>(i) * n_biomes, probs.begin() + static_cast<std::size_t>(i + 1) * n_biomes);
 
-        map[i].biome_prob = elementWiseAdd(map[i].biome_prob, probs);
-        
         // make it a probability again
         map[i].biome_prob = scalarMultiplication(map[i].biome_prob, 1.f / (sum_vec_float(map[i].biome_prob) + 1e-8));
 
@@ -694,93 +1245,435 @@ void calcBiome(std::vector<Cell>& map, GlobalWorldObjects& globals, int kmeans_m
     }
 }
 
-void calcLakes(std::vector<Cell>& map)
+constexpr int WIND_BAND_BINS = 1024; // Latitude bins of the band lookup in calcWind
+
+// Wind band (the convergence line above the cell) for every latitude bin, lines are sorted from the top of the map
+// A bin can still hold the start of the next band, so the lookup is finished by stepping over the lines below it
+void windBandTable(const std::vector<float>& lines, std::vector<int>& table)
+{
+    table.resize(WIND_BAND_BINS);
+    int band = 0;
+    for (int b = 0; b < WIND_BAND_BINS; b++)
+    {
+        const float latitude = static_cast<float>(b) / WIND_BAND_BINS;
+        while (band + 1 < static_cast<int>(lines.size()) && lines[band + 1] <= latitude) { band++; }
+        table[b] = band;
+    }
+}
+
+// Wind of every cell from its band, with per cell jitter from the hash so it is the same for any thread count,
+// then one double buffered average over the neighbors (the cell itself is left out like before)
+// Wind is kept as a unit vector (windX, windY), windDir is only derived from it for drawing
+void calcWind(std::vector<Cell>& map, const CellGraph& graph, const std::vector<sf::Vector2f>& points, const int MAXHEIGHT, GlobalWorldObjects& globals, unsigned int seed)
 {
+    const int n = graph.size();
+    const std::vector<float>& lines = globals.convergenceLines;
+    if (lines.empty()) { return; }
+    std::vector<int> table;
+    windBandTable(lines, table);
+
+    std::vector<float> wind(3 * static_cast<std::size_t>(n)); // x, y and strength of every cell
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        const float latitude = points[map[i].id].y / MAXHEIGHT;
+        int band = table[std::min(std::max(static_cast<int>(latitude * WIND_BAND_BINS), 0), WIND_BAND_BINS - 1)];
+        while (band + 1 < static_cast<int>(lines.size()) && lines[band + 1] <= latitude) { band++; }
+
+        map[i].windBand = band;
+        const float direction = radians(globals.windDirection[band] + 360.f * hashRandomBetween(seed, i, -0.3f, 0.3f));
+        wind[3 * i] = std::cos(direction);
+        wind[3 * i + 1] = std::sin(direction);
+        wind[3 * i + 2] = clamp((globals.windStrength[band] + hashRandomBetween(seed + 1, i, -0.5f, 0.5f)) * (1 - clamp(map[i].height, 0.6f, 0.4f)) * 2, 1.f, 0.f);
+    }
+
+    // Average of the neighbors from the old values into the cells
+    std::vector<float> averaged = wind;
+    smoothGraph(graph, averaged, 3, 1);
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        const float sum_x = averaged[3 * i];
+        const float sum_y = averaged[3 * i + 1];
+        const float length = std::sqrt(sum_x * sum_x + sum_y * sum_y);
+        Cell& cell = map[i];
+        if (length > 0.f)
+        {
+            cell.windX = sum_x / length;
+            cell.windY = sum_y / length;
+        }
+        else
+        {
+            cell.windX = wind[3 * i];
+            cell.windY = wind[3 * i + 1];
+        }
+        cell.windDir = normalizeAngle(std::atan2(cell.windY, cell.windX) * 180.f / PI);
+        cell.windStr = averaged[3 * i + 2];
+    }
+}
+
 
+// Landmasses and water bodies, only recomputed after the heights or the sea level changed
+void updateComponents(const std::vector<Cell>& map, const CellGraph& graph, const std::vector<sf::Vector2f>& points, GlobalWorldObjects& globals)
+{
+    if (globals.componentsValid && globals.landmasses.id.size() == map.size()) { return; }
+    const int n = static_cast<int>(map.size());
+    std::vector<char> land(n);
+    std::vector<char> water(n);
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        land[i] = !map[i].oceanBool;
+        water[i] = map[i].oceanBool;
+    }
+    labelComponents(graph, land, points, globals.landmasses);
+    labelComponents(graph, water, points, globals.waterBodies);
+    globals.componentsValid = true;
 }
 
-void calcWind(std::vector<Cell>& map, const std::vector<sf::Vector2f>& points, const int MAXHEIGHT, GlobalWorldObjects& globals)
+struct CurrentSettings
 {
-    std::vector<float> wind = scalarMultiplication(globals.convergenceLines, (float)MAXHEIGHT);
+    float ekman = 30.f; // Degrees the current turns from the wind, right in the north and left in the south
+    float speed = 1.f; // Speed of a current under full strength wind, in mean edge lengths per step
+    int minCells = 200; // Water bodies smaller than this have no currents
+    int steps = 4; // Semi-Lagrangian heat advection steps
+};
 
-    for (int i = 0; i < map.size(); i++)
+// Ocean currents from the band winds, turned by the Ekman angle and deflected along the coasts,
+// then the ocean temperatures are carried along them with a few semi-Lagrangian steps
+// Every stage is one pass over the edges of the ocean cells, so it costs about the same as calcWind
+void calcCurrents(std::vector<Cell>& map, const CellGraph& graph, const std::vector<sf::Vector2f>& points, const int MAXHEIGHT, GlobalWorldObjects& globals, const CurrentSettings& settings = CurrentSettings())
+{
+    const int n = graph.size();
+    if (n == 0) { return; }
+    updateComponents(map, graph, points, globals);
+    const Components& water = globals.waterBodies;
+
+    // Wind driven current, the Coriolis force turns it to the right in the north (y grows to the south)
+    std::vector<float> current(2 * static_cast<std::size_t>(n), 0.f);
+    std::vector<char> open(n);
+    const float turn = radians(settings.ekman);
+    const float speed = settings.speed * graph.meanEdgeLength;
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        const Cell& cell = map[i];
+        open[i] = cell.oceanBool && water.id[i] >= 0 && water.size[water.id[i]] >= settings.minCells;
+        if (!open[i]) { continue; }
+        const float angle = points[i].y < 0.5f * MAXHEIGHT ? turn : -turn;
+        const float c = std::cos(angle);
+        const float s = std::sin(angle);
+        current[2 * i] = speed * cell.windStr * (c * cell.windX - s * cell.windY);
+        current[2 * i + 1] = speed * cell.windStr * (s * cell.windX + c * cell.windY);
+    }
+    smoothGraph(graph, current, 2, 1, SmoothSettings(), &open);
+
+    // Currents can not flow into land, the part towards the coast is turned along it with the same speed
+    // Then the semi-Lagrangian weights: the departure point lies upstream, its temperature comes from the neighbors in that
+    // direction weighted by how well they line up, and the cell moves towards it by the share of an edge the current covers
+    // in a step. The currents do not change between the steps, so the weights are found once
+    std::vector<float> upstream(graph.adj.size(), 0.f);
+    std::vector<float> keep(n, 1.f);
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
     {
-        int closestLine = 0;
-        float min_dist = 1000000.f;
-        for (int j = 0; j < wind.size(); j++)
+        Cell& cell = map[i];
+        if (!open[i])
+        {
+            cell.currentX = 0.f;
+            cell.currentY = 0.f;
+            continue;
+        }
+        float x = current[2 * i];
+        float y = current[2 * i + 1];
+        float normal_x = 0.f;
+        float normal_y = 0.f;
+        for (int j = graph.begin(i); j < graph.end(i); j++)
         {
-            float dist = points[map[i].id].y - wind[j];
-            if (abs(dist) < min_dist)
+            if (map[graph.adj[j]].oceanBool) { continue; }
+            normal_x += graph.edgeDirX[j];
+            normal_y += graph.edgeDirY[j];
+        }
+        const float length = std::sqrt(x * x + y * y);
+        const float normal_length = std::sqrt(normal_x * normal_x + normal_y * normal_y);
+        if (normal_length > 0.f)
+        {
+            normal_x /= normal_length;
+            normal_y /= normal_length;
+            const float into = x * normal_x + y * normal_y;
+            if (into > 0.f)
             {
-                if (dist < 0)
-                {
-                    min_dist = abs(dist);
-                    closestLine = j - 1;
-                }
-                else
+                x -= into * normal_x;
+                y -= into * normal_y;
+                const float along = std::sqrt(x * x + y * y);
+                if (along > 0.f)
                 {
-                    min_dist = abs(dist);
-                    closestLine = j;
+                    x *= length / along;
+                    y *= length / along;
                 }
-			}
+            }
         }
+        cell.currentX = x;
+        cell.currentY = y;
+        if (length == 0.f) { continue; }
 
-        map[i].windDir = normalizeAngle(globals.windDirection[closestLine] + 360.f * RandomBetween(-0.3,0.3));
-        map[i].windStr = clamp((globals.windStrength[closestLine] + RandomBetween(-0.5,0.5)) * (1 - clamp(map[i].height,0.6f,0.4f)) * 2, 1.f, 0.f);
-	}
-    // get averages of neighbors direction and strength
-    for (int i = 0; i < map.size(); i++)
-    {
-        float sumX = 0.0;
-        float sumY = 0.0;
-        float sumStr = 0.0;
-        for (int j = 0; j < map[i].neighbors.size(); j++)
+        float weight = 0.f;
+        float reach = 0.f;
+        for (int j = graph.begin(i); j < graph.end(i); j++)
         {
-            float radian = radians(map[map[i].neighbors[j]].windDir);
-            sumX += std::cos(radian);
-            sumY += std::sin(radian);
+            if (!open[graph.adj[j]]) { continue; }
+            const float against = -(graph.edgeDirX[j] * x + graph.edgeDirY[j] * y) / length;
+            if (against <= 0.f) { continue; }
+            upstream[j] = against * against;
+            weight += upstream[j];
+            reach += upstream[j] * against * graph.edgeLength[j];
+        }
+        if (weight == 0.f || reach == 0.f) { continue; }
+        const float share = std::min(1.f, length * weight / reach);
+        keep[i] = 1.f - share;
+        for (int j = graph.begin(i); j < graph.end(i); j++)
+        {
+            upstream[j] *= share / weight;
+        }
+    }
 
-            sumStr += map[map[i].neighbors[j]].windStr;
+    std::vector<float> temp;
+    gatherField(map, temp, &Cell::temp);
+    std::vector<float> next(n);
+    for (int step = 0; step < settings.steps; step++)
+    {
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            float value = keep[i] * temp[i];
+            if (keep[i] < 1.f)
+            {
+                for (int j = graph.begin(i); j < graph.end(i); j++)
+                {
+                    value += upstream[j] * temp[graph.adj[j]];
+                }
+            }
+            next[i] = value;
         }
-        float averageRadians = std::atan2f(sumY, sumX);
-        map[i].windDir = normalizeAngle(averageRadians * 180.0 / PI);
-        map[i].windStr = sumStr / map[i].neighbors.size();
+        temp.swap(next);
     }
+    scatterField(map, temp, &Cell::temp);
 }
 
-
-void calcSnow(std::vector<Cell>& map, GlobalWorldObjects& globals)
+// Distance from every land cell to the nearest ocean cell along the adjacency, in pixels
+// Only ocean cells with a land neighbor can start a shortest path, they are the sources and the rest of the ocean stays at 0
+// Land next to the ocean is marked as coast by a pass over the land cells, so every cell is written by one thread
+void closeOceanCell(std::vector<Cell>& map, const CellGraph& graph)
 {
+    const int n = graph.size();
+    std::vector<char> land(n);
+    std::vector<float> distance(n);
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        land[i] = !map[i].oceanBool;
+        distance[i] = map[i].oceanBool ? 0.f : std::numeric_limits<float>::max();
+    }
 
-}
-
-void calcIce(std::vector<Cell>& map, GlobalWorldObjects& globals)
-{
+    std::vector<int> sources;
+    std::vector<std::vector<int>> local_sources(thread_count());
+    #pragma omp parallel
+    {
+        std::vector<int>& local = local_sources[thread_id()];
+        local.clear();
+        #pragma omp for schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            if (land[i]) { continue; }
+            for (int j = graph.begin(i); j < graph.end(i); j++)
+            {
+                if (land[graph.adj[j]])
+                {
+                    local.push_back(i);
+                    break;
+                }
+            }
+        }
+    }
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        if (!land[i]) { continue; }
+        for (int j = graph.begin(i); j < graph.end(i); j++)
+        {
+            if (!land[graph.adj[j]])
+            {
+                map[i].coastBool = true;
+                break;
+            }
+        }
+    }
+    for (std::size_t t = 0; t < local_sources.size(); t++)
+    {
+        sources.insert(sources.end(), local_sources[t].begin(), local_sources[t].end());
+    }
 
+    if (n >= DISTANCE_PARALLEL_CELLS && thread_count() > 1)
+    {
+        shortestDistancesParallel(graph, sources, land, distance, 2.f * graph.meanEdgeLength);
+    }
+    else
+    {
+        shortestDistances(graph, sources, land, distance);
+    }
+    scatterField(map, distance, &Cell::distToOcean);
 }
 
-// Will Queue up all ocean cells then evaluate neighbors and que up any that are smaller than the current distance
-void closeOceanCell(std::vector<Cell>& map, const std::vector<sf::Vector2f>& points, const GlobalWorldObjects& globals)
+// Move the sea level without regenerating, only the cells between the old and the new level change ocean state
+// Distances to the ocean are repaired locally with the same edge lengths as closeOceanCell:
+// a rising sea only shortens them, so a Dijkstra from the new ocean is enough,
+// a falling sea invalidates the new land and every cell whose shortest path went through it, which are then recomputed
+// Flooded cells lose their river, lake and basin, land that comes up keeps none until the hydrology is recomputed
+// Cells that changed ocean state are returned in changed so only their colors need updating
+void updateSeaLevel(std::vector<Cell>& map, const CellGraph& graph, GlobalWorldObjects& globals, float level, std::vector<int>& changed)
 {
-    std::vector<int> queue = globals.oceanCells;
-    while (!queue.empty())
+    changed.clear();
+    const float old_level = globals.seaLevel;
+    globals.setSeaLevel(level);
+    level = globals.seaLevel;
+    if (level == old_level || map.empty()) { return; }
+
+    std::vector<int>& order = globals.heightOrder;
+    if (order.size() != map.size())
+    {
+        order.resize(map.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&map](int a, int b) { return map[a].height < map[b].height; });
+    }
+    const float delta = globals.coastDelta;
+    const int old_end = heightRank(map, order, old_level);
+    const int new_end = heightRank(map, order, level);
+    const int first = std::min(old_end, new_end);
+    const int last = std::max(old_end, new_end);
+    const bool rising = new_end > old_end;
+
+    // Ocean is the prefix of the height order, only the cells between the two ranks flip
+    changed.assign(order.begin() + first, order.begin() + last);
+
+    RadixHeap heap;
+    if (rising)
+    {
+        for (int cell : changed)
+        {
+            map[cell].oceanBool = true;
+            map[cell].distToOcean = 0.f;
+            heap.push(0.f, cell);
+        }
+    }
+    else
     {
-		int idx = pop_front_i(queue);
-        for (int i = 0; i < map[idx].neighbors.size(); i++)
+        // Old distances are still in place, a land cell depends on an invalid one if that one was on its shortest path
+        std::vector<int> invalid = changed;
+        std::vector<char> is_invalid(map.size(), 0);
+        for (int cell : changed)
+        {
+            map[cell].oceanBool = false;
+            is_invalid[cell] = 1;
+        }
+        for (std::size_t k = 0; k < invalid.size(); k++)
         {
-            if (!map[map[idx].neighbors[i]].oceanBool)
+            const int cell = invalid[k];
+            for (int j = graph.begin(cell); j < graph.end(cell); j++)
             {
-                // Assign coastBool if not already assigned
-                map[map[idx].neighbors[i]].coastBool = map[idx].oceanBool;
-                // Calculate distance to Ocean
-                float distance = dist(points[map[idx].neighbors[i]], points[idx]) + map[idx].distToOcean;
-                if (map[map[idx].neighbors[i]].distToOcean > distance)
+                const int neighbor = graph.adj[j];
+                if (map[neighbor].oceanBool || is_invalid[neighbor] || map[neighbor].distToOcean == std::numeric_limits<float>::max()) { continue; }
+                if (map[neighbor].distToOcean == map[cell].distToOcean + graph.edgeLength[j])
                 {
-                    map[map[idx].neighbors[i]].distToOcean = distance;
-                    queue.push_back(map[idx].neighbors[i]);
+                    invalid.push_back(neighbor);
+                    is_invalid[neighbor] = 1;
                 }
-			}
-		}
-	}
+            }
+        }
+        for (int cell : invalid)
+        {
+            map[cell].distToOcean = std::numeric_limits<float>::max();
+        }
+        // Restart every invalid cell from its best valid neighbor
+        for (int cell : invalid)
+        {
+            float best = std::numeric_limits<float>::max();
+            for (int j = graph.begin(cell); j < graph.end(cell); j++)
+            {
+                const int neighbor = graph.adj[j];
+                if (map[neighbor].distToOcean == std::numeric_limits<float>::max()) { continue; }
+                best = std::min(best, map[neighbor].distToOcean + graph.edgeLength[j]);
+            }
+            if (best < std::numeric_limits<float>::max())
+            {
+                map[cell].distToOcean = best;
+                heap.push(best, cell);
+            }
+        }
+    }
+
+    while (!heap.empty())
+    {
+        const std::pair<float, int> top = heap.pop();
+        if (top.first > map[top.second].distToOcean) { continue; }
+        for (int j = graph.begin(top.second); j < graph.end(top.second); j++)
+        {
+            const int neighbor = graph.adj[j];
+            if (map[neighbor].oceanBool) { continue; }
+            const float distance = top.first + graph.edgeLength[j];
+            if (distance < map[neighbor].distToOcean)
+            {
+                map[neighbor].distToOcean = distance;
+                heap.push(distance, neighbor);
+            }
+        }
+    }
+
+    if (rising)
+    {
+        globals.oceanCells.insert(globals.oceanCells.end(), changed.begin(), changed.end());
+        for (int cell : changed)
+        {
+            Cell& flooded = map[cell];
+            if (flooded.basin >= 0)
+            {
+                globals.basins[flooded.basin].area -= graph.area[cell];
+                globals.basins[flooded.basin].numCells--;
+            }
+            flooded.riverBool = false;
+            flooded.riverStr = 0.f;
+            flooded.river = -1;
+            flooded.lakeBool = false;
+            flooded.lake = -1;
+            flooded.basin = -1;
+        }
+        globals.riverCells.erase(std::remove_if(globals.riverCells.begin(), globals.riverCells.end(), [&map](int cell) { return !map[cell].riverBool; }), globals.riverCells.end());
+        globals.lakeCells.erase(std::remove_if(globals.lakeCells.begin(), globals.lakeCells.end(), [&map](int cell) { return !map[cell].lakeBool; }), globals.lakeCells.end());
+    }
+    else { globals.oceanCells.erase(std::remove_if(globals.oceanCells.begin(), globals.oceanCells.end(), [&map](int cell) { return !map[cell].oceanBool; }), globals.oceanCells.end()); }
+
+    // Coast is the height band around the sea level plus land next to the ocean
+    // Only the old and new bands and the neighborhood of the changed cells can change
+    const int old_band_begin = heightRankBelow(map, order, old_level - delta);
+    const int old_band_end = heightRank(map, order, old_level + delta);
+    const int band_begin = heightRankBelow(map, order, level - delta);
+    const int band_end = heightRank(map, order, level + delta);
+    std::vector<int> touched(order.begin() + old_band_begin, order.begin() + old_band_end);
+    touched.insert(touched.end(), order.begin() + band_begin, order.begin() + band_end);
+    for (int cell : changed)
+    {
+        touched.insert(touched.end(), graph.adj.begin() + graph.begin(cell), graph.adj.begin() + graph.end(cell));
+    }
+    touched.insert(touched.end(), changed.begin(), changed.end());
+    for (int cell : touched)
+    {
+        const float height = map[cell].height;
+        bool coast = height >= level - delta && height <= level + delta;
+        for (int j = graph.begin(cell); j < graph.end(cell) && !coast && !map[cell].oceanBool; j++)
+        {
+            coast = map[graph.adj[j]].oceanBool;
+        }
+        map[cell].coastBool = coast;
+    }
+    globals.coastCells.assign(order.begin() + band_begin, order.begin() + band_end);
 }
 
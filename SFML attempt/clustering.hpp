@@ -4,6 +4,8 @@
 #include <string>
 #include <exception>
 #include <random>
+#include <algorithm>
+#include <limits>
 
 class ClusteringMethod {
 public:
@@ -17,116 +19,165 @@ public:
 };
 
 
+// Centroid and size of a cluster, the points are only referenced through the cluster ids
 class Cluster {
 private:
 	int id;
+	int size = 0;
 	std::vector<float> centroid;
-	std::vector<std::vector<float>> points;
 
 public:
-	Cluster(int id, std::vector<float> centroid, int point_count) : id(id), centroid(centroid) { points.reserve(point_count); }
-
-	void addPoint(std::vector<float> point) {
-		points.push_back(point);
-	}
-
-	void clearPoints() {
-		points.clear();
-	}
-
-	const std::vector<std::vector<float>>& getPoints() const {
-		return points;
-	}
+	Cluster(int id, std::vector<float> centroid) : id(id), centroid(centroid) {}
 
 	const std::vector<float>& getCentroid() const {
 		return centroid;
 	}
 
-	void setCentroid(std::vector<float>& newCentroid) {
+	void setCentroid(const std::vector<float>& newCentroid) {
 		centroid = newCentroid;
 	}
 
+	void setSize(int newSize) {
+		size = newSize;
+	}
+
 	int getId() const {
 		return id;
 	}
 
 	int getSize() const {
-		return points.size();
+		return size;
 	}
 };
 
+constexpr int KMEANS_CHUNKS = 64; // Fixed chunks of points with their own partial sums, so the result is the same for any thread count
+
+struct KMeansSettings
+{
+	int maxIterations = 100;
+	float maxShift = 1e-3f; // Stop when no centroid moved more than this (in standard deviations, the data is standardized)
+	float changedFraction = 1e-3f; // Stop when less than this share of the points changed cluster
+};
+
+// What one iteration did, distances counts the point to centroid distances that were actually computed
+struct KMeansStats
+{
+	int iteration = 0;
+	int changed = 0;
+	long long distances = 0;
+	float maxShift = 0.f;
+};
+
+// Lloyd's k-means with Hamerly's bounds: every point keeps an upper bound on the distance to its centroid and a lower bound
+// on the distance to any other centroid, both moved by the centroid shifts after every update. While the upper bound is below
+// the lower bound (or half the distance from its centroid to the closest other one) the point can not change cluster,
+// so once the clusters settle most points are skipped without computing any distance
 class KMeans : public ClusteringMethod{
 private:
 	int k;
 	int dimensions;
-	int iters;
+	KMeansSettings settings;
 	std::vector<Cluster> clusters;
-	std::vector<std::vector<float>> data;
+	std::vector<float> data; // Standardized points back to back, point i starts at i * dimensions
+	int numPoints = 0;
 
 	std::vector<int> clusterIds;
 	std::vector<int> clusterSizes;
 
+	std::vector<float> centroids; // Centroids back to back, the copy the assignment reads
+	std::vector<double> sums; // Per chunk sums of the points of every cluster (KMEANS_CHUNKS x k x dimensions), kept between iterations
+	std::vector<int> counts; // Per chunk sizes of every cluster (KMEANS_CHUNKS x k)
+
+	std::vector<float> upper; // Upper bound on the distance of every point to its centroid
+	std::vector<float> lower; // Lower bound on the distance of every point to the second closest centroid
+	std::vector<float> halfGap; // Half the distance from every centroid to the closest other one
+	std::vector<float> shift; // How far every centroid moved in the last update
+	std::vector<KMeansStats> stats;
+
 	std::vector<float> mean;
 	std::vector<float> stdDev;
 
 public:
-	KMeans(int k, int dimensions, int iters) : k(k), dimensions(dimensions), iters(iters) { clusterSizes.resize(k, 0); }
+	KMeans(int k, int dimensions, int iters) : k(k), dimensions(dimensions) { settings.maxIterations = iters; clusterSizes.resize(k, 0); }
+	KMeans(int k, int dimensions, const KMeansSettings& settings) : k(k), dimensions(dimensions), settings(settings) { clusterSizes.resize(k, 0); }
 
 	void setData(const std::vector<std::vector<float>>& data) override {
-		this->data = data;
-		clusterIds.resize(data.size(), -1);
+		numPoints = static_cast<int>(data.size());
+		this->data.resize(static_cast<std::size_t>(numPoints) * dimensions);
+		for (int i = 0; i < numPoints; ++i) {
+			for (int d = 0; d < dimensions; ++d) {
+				this->data[static_cast<std::size_t>(i) * dimensions + d] = data[i][d];
+			}
+		}
+		clusterIds.assign(numPoints, -1);
 		standardize();
 	}
 
+	const float* point(int i) const {
+		return &data[static_cast<std::size_t>(i) * dimensions];
+	}
+
 	void init() {
 		std::vector<int> usedIndices;
-		std::size_t dataSize = data.size();
+		clusters.clear();
 
 		for (int i = 0; i < k; ++i) {
-			int index = rand() % dataSize;
+			int index = rand() % numPoints;
 			do {
-				index = rand() % dataSize;
+				index = rand() % numPoints;
 			} while (std::find(usedIndices.begin(), usedIndices.end(), index) != usedIndices.end());
 
 			usedIndices.push_back(index);
-			clusters.emplace_back(Cluster(i, data[index], dataSize / (k / 2)));
+			clusters.emplace_back(Cluster(i, std::vector<float>(point(index), point(index) + dimensions)));
+		}
+		centroids.resize(static_cast<std::size_t>(k) * dimensions);
+		for (int c = 0; c < k; ++c) {
+			std::copy(clusters[c].getCentroid().begin(), clusters[c].getCentroid().end(), centroids.begin() + static_cast<std::size_t>(c) * dimensions);
 		}
+		sums.assign(static_cast<std::size_t>(KMEANS_CHUNKS) * k * dimensions, 0.0);
+		counts.assign(static_cast<std::size_t>(KMEANS_CHUNKS) * k, 0);
+		clusterIds.assign(numPoints, -1);
+		upper.assign(numPoints, 0.f);
+		lower.assign(numPoints, 0.f);
+		halfGap.assign(k, 0.f);
+		shift.assign(k, 0.f);
+		stats.clear();
 	}
 	
 	void standardize() {
 		// get mean and standard deviation for each dimension
-		mean.resize(dimensions, 0);
-		stdDev.resize(dimensions, 0);
+		mean.assign(dimensions, 0);
+		stdDev.assign(dimensions, 0);
 
-		for (const auto& point : data) {
+		for (int p = 0; p < numPoints; ++p) {
 			for (int i = 0; i < dimensions; ++i) {
-				mean[i] += point[i];
+				mean[i] += point(p)[i];
 			}
 		}
 
 		for (int i = 0; i < dimensions; ++i) {
-			mean[i] /= data.size();
+			mean[i] /= numPoints;
 		}
 
-		for (const auto& point : data) {
+		for (int p = 0; p < numPoints; ++p) {
 			for (int i = 0; i < dimensions; ++i) {
-				stdDev[i] += (point[i] - mean[i]) * (point[i] - mean[i]);
+				stdDev[i] += (point(p)[i] - mean[i]) * (point(p)[i] - mean[i]);
 			}
 		}
 
 		for (int i = 0; i < dimensions; ++i) {
-			stdDev[i] = sqrt(stdDev[i] / data.size());
+			stdDev[i] = sqrt(stdDev[i] / numPoints);
 		}
 
 		// standardize data
-		for (auto& point : data) {
+		for (int p = 0; p < numPoints; ++p) {
 			for (int i = 0; i < dimensions; ++i) {
-				point[i] = (point[i] - mean[i]) / stdDev[i];
+				data[static_cast<std::size_t>(p) * dimensions + i] = (point(p)[i] - mean[i]) / stdDev[i];
 			}
 		}
 	}
 
-	float distance(const std::vector<float>& a, const std::vector<float>& b) {
+	float distance(const float* a, const float* b) const {
 		float distance = 0;
 		
 		for (int i = 0; i < dimensions; ++i) {
@@ -136,78 +187,146 @@ public:
 		return distance; // sqrt(distance) if needed
 	}
 
-	bool assignPoints() {
-		bool done = true;
-		
-		#pragma omp parallel for reduction(&&: done) num_threads(16) schedule(static)
-		for (int i = 0; i < data.size(); ++i) {
-			const std::vector<float>& point = data[i];
-			int bestCluster = 0; // NEEDS to be -1 
-			float minDistance = std::numeric_limits<float>::max();
+	const float* centroid(int c) const {
+		return &centroids[static_cast<std::size_t>(c) * dimensions];
+	}
 
-			for (int j = 0; j < clusters.size(); ++j) {
-				float dist = distance(point, clusters[j].getCentroid());
+	// Assign the points that can have changed cluster, moving them between the sums of their chunk, no locks and no copies of the points
+	void assignPoints(KMeansStats& stat) {
+		// Half the gap from every centroid to its closest neighbor, a point closer than that to its centroid stays
+		for (int c = 0; c < k; ++c) {
+			float closest = std::numeric_limits<float>::max();
+			for (int o = 0; o < k; ++o) {
+				if (o != c) { closest = std::min(closest, distance(centroid(c), centroid(o))); }
+			}
+			halfGap[c] = 0.5f * std::sqrt(closest);
+		}
 
-				if (dist < minDistance) {
-					minDistance = dist;
-					bestCluster = j;
+		int changed = 0;
+		long long evaluations = 0;
+		#pragma omp parallel for reduction(+: changed, evaluations) schedule(static)
+		for (int chunk = 0; chunk < KMEANS_CHUNKS; ++chunk) {
+			const int first = static_cast<int>(static_cast<long long>(numPoints) * chunk / KMEANS_CHUNKS);
+			const int last = static_cast<int>(static_cast<long long>(numPoints) * (chunk + 1) / KMEANS_CHUNKS);
+			double* sum = &sums[static_cast<std::size_t>(chunk) * k * dimensions];
+			int* count = &counts[static_cast<std::size_t>(chunk) * k];
+			for (int i = first; i < last; ++i) {
+				const float* p = point(i);
+				const int assigned = clusterIds[i];
+				if (assigned >= 0) {
+					const float bound = std::max(halfGap[assigned], lower[i]);
+					if (upper[i] <= bound) { continue; }
+					// Tighten the upper bound, the bounds still hold with the exact distance
+					upper[i] = std::sqrt(distance(p, centroid(assigned)));
+					evaluations++;
+					if (upper[i] <= bound) { continue; }
 				}
-			}
-			// How does bestCluster end up being -1? Percepitation is nan so dist does not work..
-			
-			if (clusterIds[i] != bestCluster) {
-				done = false;
-			}
-			clusterIds[i] = bestCluster;
 
-			#pragma omp critical
-			{
-				clusters[bestCluster].addPoint(point);
+				int bestCluster = 0; // Points with a nan value end up in cluster 0
+				float minDistance = std::numeric_limits<float>::max();
+				float secondDistance = std::numeric_limits<float>::max();
+				for (int j = 0; j < k; ++j) {
+					float dist = distance(p, centroid(j));
+					if (dist < minDistance) {
+						secondDistance = minDistance;
+						minDistance = dist;
+						bestCluster = j;
+					}
+					else if (dist < secondDistance) {
+						secondDistance = dist;
+					}
+				}
+				evaluations += k;
+				upper[i] = std::sqrt(minDistance);
+				lower[i] = std::sqrt(secondDistance);
+
+				if (assigned == bestCluster) { continue; }
+				changed++;
+				clusterIds[i] = bestCluster;
+				if (assigned >= 0) {
+					count[assigned]--;
+					for (int d = 0; d < dimensions; ++d) {
+						sum[static_cast<std::size_t>(assigned) * dimensions + d] -= p[d];
+					}
+				}
+				count[bestCluster]++;
+				for (int d = 0; d < dimensions; ++d) {
+					sum[static_cast<std::size_t>(bestCluster) * dimensions + d] += p[d];
+				}
 			}
 		}
-		return done;
+		stat.changed = changed;
+		stat.distances = evaluations;
 	}
 
-	void updateCentroids() {
-		#pragma omp parallel for num_threads(16) schedule(static)
-		for (int i = 0; i < clusters.size(); ++i) {
-			std::vector<float> newCentroid(dimensions, 0);
-			const std::vector<std::vector<float>>& points = clusters[i].getPoints();
-			int numPoints = points.size();
-
-			if (numPoints == 0) {
-				continue;
-			}
-
-
-			for (const auto& point : points) {
-				for (int k = 0; k < dimensions; ++k) {
-					newCentroid[k] += point[k];
+	// Reduce the chunk sums in chunk order, clusters that lost all their points keep their centroid
+	// The bounds of every point are then loosened by the shifts, returns the largest shift
+	float updateCentroids() {
+		std::vector<float> newCentroid(dimensions);
+		std::vector<double> total(dimensions);
+		for (int c = 0; c < k; ++c) {
+			int size = 0;
+			std::fill(total.begin(), total.end(), 0.0);
+			for (int chunk = 0; chunk < KMEANS_CHUNKS; ++chunk) {
+				size += counts[static_cast<std::size_t>(chunk) * k + c];
+				for (int d = 0; d < dimensions; ++d) {
+					total[d] += sums[(static_cast<std::size_t>(chunk) * k + c) * dimensions + d];
 				}
 			}
 
-			for (int k = 0; k < dimensions; ++k) {
-				newCentroid[k] /= numPoints;
+			clusterSizes[c] = size;
+			clusters[c].setSize(size);
+			shift[c] = 0.f;
+			if (size == 0) {
+				continue;
 			}
 
-			clusterSizes[i] = clusters[i].getSize();
+			for (int d = 0; d < dimensions; ++d) {
+				newCentroid[d] = static_cast<float>(total[d] / size);
+			}
+			shift[c] = std::sqrt(distance(newCentroid.data(), centroid(c)));
+			std::copy(newCentroid.begin(), newCentroid.end(), centroids.begin() + static_cast<std::size_t>(c) * dimensions);
+			clusters[c].setCentroid(newCentroid);
+		}
 
-			clusters[i].setCentroid(newCentroid);
-			clusters[i].clearPoints();
+		// The lower bound drops by the largest shift of any other centroid
+		int largest = 0;
+		for (int c = 1; c < k; ++c) {
+			if (shift[c] > shift[largest]) { largest = c; }
+		}
+		float second = 0.f;
+		for (int c = 0; c < k; ++c) {
+			if (c != largest) { second = std::max(second, shift[c]); }
+		}
+		#pragma omp parallel for schedule(static)
+		for (int i = 0; i < numPoints; ++i) {
+			const int assigned = clusterIds[i];
+			upper[i] += shift[assigned];
+			lower[i] -= assigned == largest ? second : shift[largest];
 		}
+		return shift[largest];
 	}
 
+	// Iterate until the assignments or the centroids settle, or settings.maxIterations is reached
 	void run() override {
 		init();
-		bool done = false;
-		int iter = 0;
-		while (!done || iter < iters) {
-			done = assignPoints();
-			updateCentroids();
-			iter++;
+		for (int iter = 0; iter < settings.maxIterations; ++iter) {
+			KMeansStats stat;
+			stat.iteration = iter;
+			assignPoints(stat);
+			stat.maxShift = updateCentroids();
+			stats.push_back(stat);
+
+			if (stat.changed <= settings.changedFraction * numPoints || stat.maxShift <= settings.maxShift) {
+				break;
+			}
 		}
 	}
 
+	const std::vector<KMeansStats>& getStats() const {
+		return stats;
+	}
+
 	int getClusterId(int index) override {
 		return clusterIds[index];
 	}
@@ -0,0 +1,442 @@
+#pragma once
+#include <vector>
+#include <atomic>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#include <initializer_list>
+#include "util.h"
+
+// Flat (CSR) adjacency of the cells, built once in fillMap and shared by the parallel kernels
+// The neighbors of cell i are adj[offsets[i]] up to adj[offsets[i + 1]]
+class CellGraph
+{
+public:
+    std::vector<int> offsets; // Start of each cell's neighbor list in adj (size is cells + 1)
+    std::vector<int> adj; // Id's of the neighbors, stored back to back
+    std::vector<float> edgeLength; // Distance between the two sites of every directed edge, same layout as adj
+    std::vector<float> edgeDirX; // Unit direction from the cell to the neighbor, same layout as adj
+    std::vector<float> edgeDirY;
+    std::vector<float> edgeBorder; // Length of the polygon side the two cells share, same layout as adj
+    std::vector<float> area; // Area of every cell's polygon
+    std::vector<char> border; // Cell touches the edge of the map
+    float meanArea = 0.f;
+    float meanEdgeLength = 0.f;
+
+    int size() const { return offsets.empty() ? 0 : static_cast<int>(offsets.size()) - 1; }
+    int begin(int i) const { return offsets[i]; }
+    int end(int i) const { return offsets[i + 1]; }
+    int degree(int i) const { return offsets[i + 1] - offsets[i]; }
+
+    void clear()
+    {
+        offsets.clear();
+        adj.clear();
+        edgeLength.clear();
+        edgeDirX.clear();
+        edgeDirY.clear();
+        edgeBorder.clear();
+        area.clear();
+        border.clear();
+        meanArea = 0.f;
+        meanEdgeLength = 0.f;
+    }
+};
+
+// Copy a member of every cell into a flat array and back, so kernels can work on contiguous data
+template <typename T, typename F>
+void gatherField(const std::vector<T>& cells, std::vector<F>& out, F T::* field)
+{
+    out.resize(cells.size());
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < static_cast<int>(cells.size()); i++)
+    {
+        out[i] = cells[i].*field;
+    }
+}
+
+template <typename T, typename F>
+void scatterField(std::vector<T>& cells, const std::vector<F>& in, F T::* field)
+{
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < static_cast<int>(cells.size()); i++)
+    {
+        cells[i].*field = in[i];
+    }
+}
+
+enum SmoothWeight { SMOOTH_UNIFORM, SMOOTH_EDGE_LENGTH, SMOOTH_AREA };
+
+struct SmoothSettings
+{
+    SmoothWeight weight = SMOOTH_UNIFORM; // Neighbors count the same, by inverse edge length, or by their area
+    float self = 0.f; // Share a cell keeps of its own value, 0 is the plain neighbor average
+};
+
+// Neighbor averaging shared by the smoothing stages, double buffered so the result does not depend on the cell order
+// values holds stride numbers per cell back to back, so several attributes are smoothed in one sweep over the edges
+// Cells with mask[i] == 0 keep their values but still count as neighbors
+template <typename T>
+void smoothGraph(const CellGraph& graph, std::vector<T>& values, int stride, int passes, const SmoothSettings& settings = SmoothSettings(), const std::vector<char>* mask = nullptr)
+{
+    const int n = graph.size();
+    if (n == 0 || passes <= 0 || stride <= 0) { return; }
+
+    // Normalized weights of every edge, computed once for all the passes
+    std::vector<float> weight(graph.adj.size());
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        float sum = 0.f;
+        for (int j = graph.begin(i); j < graph.end(i); j++)
+        {
+            float w = 1.f;
+            if (settings.weight == SMOOTH_EDGE_LENGTH) { w = graph.edgeLength[j] > 0.f ? 1.f / graph.edgeLength[j] : 0.f; }
+            else if (settings.weight == SMOOTH_AREA) { w = graph.area[graph.adj[j]]; }
+            weight[j] = w;
+            sum += w;
+        }
+        const float scale = sum > 0.f ? (1.f - settings.self) / sum : 0.f;
+        for (int j = graph.begin(i); j < graph.end(i); j++)
+        {
+            weight[j] *= scale;
+        }
+    }
+
+    std::vector<T> next(values.size());
+    for (int p = 0; p < passes; p++)
+    {
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            const T* own = &values[static_cast<std::size_t>(i) * stride];
+            T* out = &next[static_cast<std::size_t>(i) * stride];
+            if ((mask && !(*mask)[i]) || graph.degree(i) == 0)
+            {
+                for (int k = 0; k < stride; k++) { out[k] = own[k]; }
+                continue;
+            }
+            for (int k = 0; k < stride; k++) { out[k] = settings.self * own[k]; }
+            for (int j = graph.begin(i); j < graph.end(i); j++)
+            {
+                const T* other = &values[static_cast<std::size_t>(graph.adj[j]) * stride];
+                for (int k = 0; k < stride; k++) { out[k] += weight[j] * other[k]; }
+            }
+        }
+        values.swap(next);
+    }
+}
+
+// Smooth float members of the cells together, they are interleaved into one buffer so each edge is read once per pass
+template <typename C>
+void smoothFields(std::vector<C>& cells, const CellGraph& graph, std::initializer_list<float C::*> fields, int passes, const SmoothSettings& settings = SmoothSettings(), const std::vector<char>* mask = nullptr)
+{
+    const int n = static_cast<int>(cells.size());
+    const int stride = static_cast<int>(fields.size());
+    if (passes <= 0 || stride == 0) { return; }
+    std::vector<float> values(static_cast<std::size_t>(n) * stride);
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        int k = 0;
+        for (float C::* field : fields) { values[static_cast<std::size_t>(i) * stride + k++] = cells[i].*field; }
+    }
+    smoothGraph(graph, values, stride, passes, settings, mask);
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        int k = 0;
+        for (float C::* field : fields) { cells[i].*field = values[static_cast<std::size_t>(i) * stride + k++]; }
+    }
+}
+
+// Monotone radix heap for shortest paths, popped keys never decrease so pushes are O(1) and pops amortized O(log C)
+// Non negative floats order the same as their bit patterns, so the keys are the raw bits of the distance
+class RadixHeap
+{
+public:
+    bool empty() const { return count == 0; }
+
+    void push(float key, int value)
+    {
+        const unsigned int bits = toBits(key);
+        buckets[bucketOf(bits)].push_back(Entry(bits, value));
+        count++;
+    }
+
+    // Smallest entry, the key has to be at least the last popped key
+    std::pair<float, int> pop()
+    {
+        if (buckets[0].empty())
+        { // Move the first non empty bucket down, relative to its smallest key everything lands in a lower bucket
+            int b = 1;
+            while (buckets[b].empty()) { b++; }
+            unsigned int smallest = buckets[b][0].first;
+            for (const Entry& entry : buckets[b])
+            {
+                smallest = std::min(smallest, entry.first);
+            }
+            last = smallest;
+            for (const Entry& entry : buckets[b])
+            {
+                buckets[bucketOf(entry.first)].push_back(entry);
+            }
+            buckets[b].clear();
+        }
+        const Entry entry = buckets[0].back();
+        buckets[0].pop_back();
+        count--;
+        float key;
+        std::memcpy(&key, &entry.first, sizeof(float));
+        return std::pair<float, int>(key, entry.second);
+    }
+
+    void clear()
+    {
+        for (int b = 0; b < 33; b++) { buckets[b].clear(); }
+        last = 0;
+        count = 0;
+    }
+
+private:
+    typedef std::pair<unsigned int, int> Entry;
+    std::vector<Entry> buckets[33]; // Bucket b holds keys whose highest bit differing from last is bit b - 1
+    unsigned int last = 0;
+    std::size_t count = 0;
+
+    static unsigned int toBits(float key)
+    {
+        unsigned int bits;
+        std::memcpy(&bits, &key, sizeof(float));
+        return bits;
+    }
+    int bucketOf(unsigned int bits) const
+    {
+        unsigned int x = bits ^ last;
+        int b = 0;
+        while (x) { x >>= 1; b++; }
+        return b;
+    }
+};
+
+constexpr int DISTANCE_PARALLEL_CELLS = 1 << 16; // Below this the serial radix heap beats delta stepping
+
+// Multi-source shortest paths over the edge lengths with a radix heap
+// distance is 0 at the sources and max everywhere else, only cells with open[i] are ever entered
+void shortestDistances(const CellGraph& graph, const std::vector<int>& sources, const std::vector<char>& open, std::vector<float>& distance)
+{
+    RadixHeap heap;
+    for (int source : sources)
+    {
+        heap.push(distance[source], source);
+    }
+    while (!heap.empty())
+    {
+        const std::pair<float, int> top = heap.pop();
+        if (top.first > distance[top.second]) { continue; }
+        for (int j = graph.begin(top.second); j < graph.end(top.second); j++)
+        {
+            const int neighbor = graph.adj[j];
+            const float candidate = top.first + graph.edgeLength[j];
+            if (open[neighbor] && candidate < distance[neighbor])
+            {
+                distance[neighbor] = candidate;
+                heap.push(candidate, neighbor);
+            }
+        }
+    }
+}
+
+// Same result with delta stepping: bucket k holds the cells with a distance in [k * delta, (k + 1) * delta)
+// and the cells of the current bucket relax their edges in parallel until the bucket stays empty
+void shortestDistancesParallel(const CellGraph& graph, const std::vector<int>& sources, const std::vector<char>& open, std::vector<float>& distance, float delta)
+{
+    const int n = graph.size();
+    std::vector<std::atomic<float>> tentative(n);
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        tentative[i].store(distance[i], std::memory_order_relaxed);
+    }
+
+    const float inv_delta = 1.f / delta;
+    std::vector<std::vector<int>> buckets(1);
+    for (int source : sources)
+    {
+        const std::size_t b = static_cast<std::size_t>(distance[source] * inv_delta);
+        if (b >= buckets.size()) { buckets.resize(b + 1); }
+        buckets[b].push_back(source);
+    }
+
+    std::vector<int> stamp(n, -1); // Last round a cell was in the frontier, so it is relaxed once per round
+    std::vector<int> frontier;
+    std::vector<std::vector<std::pair<std::size_t, int>>> found(thread_count());
+    int round = 0;
+    for (std::size_t b = 0; b < buckets.size(); b++)
+    {
+        while (!buckets[b].empty())
+        {
+            frontier.clear();
+            for (int cell : buckets[b])
+            { // Skip cells that already moved to a lower bucket or are in this frontier
+                const float d = tentative[cell].load(std::memory_order_relaxed);
+                if (static_cast<std::size_t>(d * inv_delta) != b || stamp[cell] == round) { continue; }
+                stamp[cell] = round;
+                frontier.push_back(cell);
+            }
+            buckets[b].clear();
+            round++;
+
+            #pragma omp parallel
+            {
+                std::vector<std::pair<std::size_t, int>>& local = found[thread_id()];
+                local.clear();
+                #pragma omp for schedule(dynamic, 256)
+                for (int f = 0; f < static_cast<int>(frontier.size()); f++)
+                {
+                    const int cell = frontier[f];
+                    const float d = tentative[cell].load(std::memory_order_relaxed);
+                    for (int j = graph.begin(cell); j < graph.end(cell); j++)
+                    {
+                        const int neighbor = graph.adj[j];
+                        if (!open[neighbor]) { continue; }
+                        const float candidate = d + graph.edgeLength[j];
+                        float current = tentative[neighbor].load(std::memory_order_relaxed);
+                        bool improved = false;
+                        while (candidate < current)
+                        {
+                            if (tentative[neighbor].compare_exchange_weak(current, candidate, std::memory_order_relaxed)) { improved = true; break; }
+                        }
+                        if (improved) { local.push_back(std::pair<std::size_t, int>(static_cast<std::size_t>(candidate * inv_delta), neighbor)); }
+                    }
+                }
+            }
+
+            for (std::size_t t = 0; t < found.size(); t++)
+            {
+                for (const std::pair<std::size_t, int>& entry : found[t])
+                {
+                    if (entry.first >= buckets.size()) { buckets.resize(entry.first + 1); }
+                    buckets[entry.first].push_back(entry.second);
+                }
+            }
+        }
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        distance[i] = tentative[i].load(std::memory_order_relaxed);
+    }
+}
+
+// Axis aligned box around the sites of a set of cells
+struct BoundingBox
+{
+    sf::Vector2f min = sf::Vector2f(std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+    sf::Vector2f max = sf::Vector2f(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max());
+
+    void add(sf::Vector2f point)
+    {
+        min.x = std::min(min.x, point.x);
+        min.y = std::min(min.y, point.y);
+        max.x = std::max(max.x, point.x);
+        max.y = std::max(max.y, point.y);
+    }
+};
+
+// Connected parts of a subset of the cells (landmasses, water bodies)
+class Components
+{
+public:
+    std::vector<int> id; // Component of every cell, -1 for cells outside the subset
+    std::vector<int> size; // Cells in every component
+    std::vector<BoundingBox> bounds;
+
+    int count() const { return static_cast<int>(size.size()); }
+
+    void clear()
+    {
+        id.clear();
+        size.clear();
+        bounds.clear();
+    }
+};
+
+// Root of x in the union find forest, halving the path on the way up
+// Parents only ever move towards the root, so a failed compare exchange just means another thread already shortened it
+inline int findRoot(std::vector<std::atomic<int>>& parent, int x)
+{
+    int p = parent[x].load(std::memory_order_relaxed);
+    while (p != x)
+    {
+        const int grandparent = parent[p].load(std::memory_order_relaxed);
+        parent[x].compare_exchange_weak(p, grandparent, std::memory_order_relaxed);
+        x = p;
+        p = parent[x].load(std::memory_order_relaxed);
+    }
+    return x;
+}
+
+// Lock free union, the larger root is hung under the smaller one so every root is the lowest cell of its component
+inline void uniteRoots(std::vector<std::atomic<int>>& parent, int a, int b)
+{
+    while (true)
+    {
+        a = findRoot(parent, a);
+        b = findRoot(parent, b);
+        if (a == b) { return; }
+        if (a < b) { std::swap(a, b); }
+        int expected = a;
+        if (parent[a].compare_exchange_strong(expected, b, std::memory_order_relaxed)) { return; }
+    }
+}
+
+// Label the connected components of the cells with inside[i] set, with a parallel union find over the edges
+// Components are numbered by their lowest cell, so the labels do not depend on the thread count
+void labelComponents(const CellGraph& graph, const std::vector<char>& inside, const std::vector<sf::Vector2f>& points, Components& components)
+{
+    const int n = graph.size();
+    std::vector<std::atomic<int>> parent(n);
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        parent[i].store(i, std::memory_order_relaxed);
+    }
+
+    #pragma omp parallel for schedule(dynamic, 1024)
+    for (int i = 0; i < n; i++)
+    {
+        if (!inside[i]) { continue; }
+        for (int j = graph.begin(i); j < graph.end(i); j++)
+        {
+            const int neighbor = graph.adj[j];
+            if (neighbor < i && inside[neighbor]) { uniteRoots(parent, i, neighbor); }
+        }
+    }
+
+    components.id.resize(n);
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        components.id[i] = inside[i] ? findRoot(parent, i) : -1;
+    }
+
+    // Roots get the numbers in cell order, then every cell takes the number of its root
+    std::vector<int> number(n, -1);
+    int count = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (components.id[i] == i) { number[i] = count++; }
+    }
+    components.size.assign(count, 0);
+    components.bounds.assign(count, BoundingBox());
+    for (int i = 0; i < n; i++)
+    {
+        if (components.id[i] < 0) { continue; }
+        const int c = number[components.id[i]];
+        components.id[i] = c;
+        components.size[c]++;
+        components.bounds[c].add(points[i]);
+    }
+}
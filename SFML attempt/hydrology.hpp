@@ -0,0 +1,563 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include <queue>
+#include <limits>
+#include "Voronoi.hpp"
+#include "graph.hpp"
+#include "util.h"
+
+// Flow over the cell graph: every cell drains into its steepest lower neighbor (its receiver)
+// The receivers form a forest rooted at outlets (sea, map border) and pits, which is stored level by level
+// so every pass over it is a linear sweep and the big levels can be split over threads
+
+class FlowGraph
+{
+public:
+    std::vector<int> receiver; // Cell that i drains into, i itself for outlets and pits
+    std::vector<float> receiverLength; // Length of the edge to the receiver, 0 for roots
+    std::vector<int> donorOffsets; // Cells that drain into i are donors[donorOffsets[i]] up to donors[donorOffsets[i + 1]]
+    std::vector<int> donors;
+    std::vector<int> order; // Cells from the roots upstream, a receiver always comes before its donors
+    std::vector<int> levelOffsets; // order[levelOffsets[l]] up to order[levelOffsets[l + 1]] is the l-th level of the forest
+
+    int size() const { return static_cast<int>(receiver.size()); }
+    int levels() const { return levelOffsets.empty() ? 0 : static_cast<int>(levelOffsets.size()) - 1; }
+
+    void clear()
+    {
+        receiver.clear();
+        receiverLength.clear();
+        donorOffsets.clear();
+        donors.clear();
+        order.clear();
+        levelOffsets.clear();
+    }
+};
+
+constexpr int FLOW_PARALLEL_LEVEL = 4096; // Levels smaller than this are not worth waking the threads for
+
+// Steepest descent receiver of every cell, outlets keep themselves as receiver
+void computeReceivers(const CellGraph& graph, const std::vector<float>& height, const std::vector<char>& outlet, FlowGraph& flow)
+{
+    const int n = graph.size();
+    flow.receiver.resize(n);
+    flow.receiverLength.resize(n);
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        int best = i;
+        float best_length = 0.f;
+        if (!outlet[i])
+        {
+            float best_slope = 0.f;
+            for (int j = graph.begin(i); j < graph.end(i); j++)
+            {
+                const float slope = (height[i] - height[graph.adj[j]]) / graph.edgeLength[j];
+                if (slope > best_slope)
+                {
+                    best_slope = slope;
+                    best = graph.adj[j];
+                    best_length = graph.edgeLength[j];
+                }
+            }
+        }
+        flow.receiver[i] = best;
+        flow.receiverLength[i] = best_length;
+    }
+}
+
+// Donor lists by a counting sort of the receivers, then the levels of the forest
+void buildFlowOrder(FlowGraph& flow)
+{
+    const int n = flow.size();
+    flow.donorOffsets.assign(n + 1, 0);
+    for (int i = 0; i < n; i++)
+    {
+        if (flow.receiver[i] != i) { flow.donorOffsets[flow.receiver[i] + 1]++; }
+    }
+    for (int i = 0; i < n; i++)
+    {
+        flow.donorOffsets[i + 1] += flow.donorOffsets[i];
+    }
+    flow.donors.resize(flow.donorOffsets[n]);
+    std::vector<int> fill(flow.donorOffsets.begin(), flow.donorOffsets.end() - 1);
+    for (int i = 0; i < n; i++)
+    {
+        if (flow.receiver[i] != i) { flow.donors[fill[flow.receiver[i]]++] = i; }
+    }
+
+    // Roots are level 0, every cell is the donor of exactly one cell so the next level is just the donors of this one
+    flow.order.resize(n);
+    flow.levelOffsets.clear();
+    flow.levelOffsets.push_back(0);
+    int level_end = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (flow.receiver[i] == i) { flow.order[level_end++] = i; }
+    }
+    int level_start = 0;
+    std::vector<int> position;
+    while (level_start < level_end)
+    {
+        flow.levelOffsets.push_back(level_end);
+        const int count = level_end - level_start;
+        position.resize(count + 1);
+        position[0] = level_end;
+        for (int k = 0; k < count; k++)
+        {
+            const int i = flow.order[level_start + k];
+            position[k + 1] = position[k] + flow.donorOffsets[i + 1] - flow.donorOffsets[i];
+        }
+
+        #pragma omp parallel for schedule(static) if(count >= FLOW_PARALLEL_LEVEL)
+        for (int k = 0; k < count; k++)
+        {
+            const int i = flow.order[level_start + k];
+            std::copy(flow.donors.begin() + flow.donorOffsets[i], flow.donors.begin() + flow.donorOffsets[i + 1], flow.order.begin() + position[k]);
+        }
+        level_start = level_end;
+        level_end = position[count];
+    }
+}
+
+// Sum the weight of every cell with everything upstream of it (drainage area when the weight is the cell area)
+void accumulateFlow(const FlowGraph& flow, const std::vector<float>& weight, std::vector<float>& accumulated)
+{
+    const int n = flow.size();
+    accumulated = weight;
+
+    if (thread_count() == 1 || n < 4 * FLOW_PARALLEL_LEVEL)
+    { // Serial path: push every cell into its receiver, from the sources down
+        for (int k = n - 1; k >= 0; k--)
+        {
+            const int i = flow.order[k];
+            if (flow.receiver[i] != i) { accumulated[flow.receiver[i]] += accumulated[i]; }
+        }
+        return;
+    }
+
+    // Parallel path: a cell pulls from its donors, which all sit one level further up, so each level is independent
+    for (int l = flow.levels() - 1; l >= 0; l--)
+    {
+        const int first = flow.levelOffsets[l];
+        const int last = flow.levelOffsets[l + 1];
+        #pragma omp parallel for schedule(static) if(last - first >= FLOW_PARALLEL_LEVEL)
+        for (int k = first; k < last; k++)
+        {
+            const int i = flow.order[k];
+            float sum = accumulated[i];
+            for (int d = flow.donorOffsets[i]; d < flow.donorOffsets[i + 1]; d++)
+            {
+                sum += accumulated[flow.donors[d]];
+            }
+            accumulated[i] = sum;
+        }
+    }
+}
+
+// Area of every cell in mean cells, so thresholds and rates do not depend on the resolution
+void meanCellAreas(const CellGraph& graph, std::vector<float>& cell_area)
+{
+    const int n = graph.size();
+    cell_area.resize(n);
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        cell_area[i] = graph.area[i] / graph.meanArea;
+    }
+}
+
+struct ErosionSettings
+{
+    int iterations = 100; // Erosion time steps
+    float erodibility = 0.002f; // K in the stream power law
+    float areaExponent = 0.5f; // m in the stream power law, n is fixed at 1 so the update stays implicit
+    float uplift = 0.f; // Height added to land cells every step
+    float dt = 1.f; // Length of a time step
+};
+
+// Stream power erosion, dh/dt = U - K A^m S, solved implicitly (Braun and Willett 2013)
+// Every step rebuilds the receivers, accumulates drainage area and then lowers each cell towards its receiver,
+// going from the outlets upstream so the receiver is always final before its donors are updated
+void erodeStreamPower(std::vector<Cell>& map, const CellGraph& graph, const GlobalWorldObjects& globals, const ErosionSettings& settings = ErosionSettings())
+{
+    const int n = graph.size();
+    if (n == 0 || settings.iterations <= 0) { return; }
+
+    std::vector<float> height;
+    gatherField(map, height, &Cell::height);
+
+    // Area and distances are measured in mean cells so the erodibility does not depend on the resolution
+    std::vector<float> cell_area;
+    meanCellAreas(graph, cell_area);
+
+    std::vector<char> outlet(n);
+    std::vector<float> drainage;
+    std::vector<float> factor(n);
+    FlowGraph flow;
+
+    for (int it = 0; it < settings.iterations; it++)
+    {
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            outlet[i] = graph.border[i] || height[i] <= globals.seaLevel;
+        }
+        computeReceivers(graph, height, outlet, flow);
+        buildFlowOrder(flow);
+        accumulateFlow(flow, cell_area, drainage);
+
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            const float area_term = settings.areaExponent == 0.5f ? std::sqrt(drainage[i]) : std::pow(drainage[i], settings.areaExponent);
+            factor[i] = flow.receiver[i] == i ? 0.f :
+                settings.erodibility * settings.dt * area_term * graph.meanEdgeLength / flow.receiverLength[i];
+        }
+
+        // Implicit update level by level, the roots (level 0) only take the uplift if they are pits on land
+        for (int l = 0; l < flow.levels(); l++)
+        {
+            const int first = flow.levelOffsets[l];
+            const int last = flow.levelOffsets[l + 1];
+            #pragma omp parallel for schedule(static) if(last - first >= FLOW_PARALLEL_LEVEL)
+            for (int k = first; k < last; k++)
+            {
+                const int i = flow.order[k];
+                if (outlet[i]) { continue; }
+                const float raised = height[i] + settings.uplift * settings.dt;
+                height[i] = (raised + factor[i] * height[flow.receiver[i]]) / (1.f + factor[i]);
+            }
+        }
+    }
+
+    std::vector<float> riseValues;
+    riseFlat(graph, height, riseValues);
+    scatterField(map, height, &Cell::height);
+    scatterField(map, riseValues, &Cell::rise);
+}
+
+// Priority flood (Barnes et al. 2014) from the outlets inwards, cells come off a binary heap lowest first
+// A cell that is not above the cell it was reached from sits in a depression, it goes through a plain queue instead of the heap,
+// which is also the fast path for flats. level is the water surface (the lowest spill height on any path to an outlet)
+// and filled is the same surface raised by the smallest float step per cell, so every cell has a strictly lower neighbor to drain to
+void fillDepressions(const CellGraph& graph, const std::vector<float>& height, const std::vector<char>& outlet,
+    std::vector<float>& level, std::vector<float>& filled, std::vector<int>& from, std::vector<int>& discovered)
+{
+    const int n = graph.size();
+    level.resize(n);
+    filled.resize(n);
+    from.assign(n, -1);
+    discovered.clear();
+    discovered.reserve(n);
+    std::vector<char> visited(n, 0);
+
+    typedef std::pair<float, int> Entry;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> heap;
+    for (int i = 0; i < n; i++)
+    {
+        if (!outlet[i]) { continue; }
+        visited[i] = 1;
+        level[i] = height[i];
+        filled[i] = height[i];
+        heap.push(Entry(height[i], i));
+        discovered.push_back(i);
+    }
+
+    std::vector<int> pit;
+    std::size_t pit_head = 0;
+    while (pit_head < pit.size() || !heap.empty())
+    {
+        int cell;
+        if (pit_head < pit.size())
+        {
+            cell = pit[pit_head++];
+            if (pit_head == pit.size()) { pit.clear(); pit_head = 0; }
+        }
+        else
+        {
+            cell = heap.top().second;
+            heap.pop();
+        }
+
+        const float step = std::nextafter(filled[cell], std::numeric_limits<float>::max());
+        for (int j = graph.begin(cell); j < graph.end(cell); j++)
+        {
+            const int neighbor = graph.adj[j];
+            if (visited[neighbor]) { continue; }
+            visited[neighbor] = 1;
+            from[neighbor] = cell;
+            discovered.push_back(neighbor);
+            level[neighbor] = std::max(height[neighbor], level[cell]);
+            if (height[neighbor] <= step)
+            {
+                filled[neighbor] = step;
+                pit.push_back(neighbor);
+            }
+            else
+            {
+                filled[neighbor] = height[neighbor];
+                heap.push(Entry(height[neighbor], neighbor));
+            }
+        }
+    }
+}
+
+// Lakes are the land cells below the water surface of the priority flood, connected lake cells form one lake
+// The filled surface is kept in globals.filledHeight so calcRivers can route through the lakes to the sea
+void calcLakes(std::vector<Cell>& map, const CellGraph& graph, const std::vector<sf::Vector2f>& points, GlobalWorldObjects& globals)
+{
+    const int n = graph.size();
+    std::vector<float> height;
+    gatherField(map, height, &Cell::height);
+    std::vector<char> outlet(n);
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        outlet[i] = graph.border[i] || map[i].oceanBool;
+    }
+
+    std::vector<float> level;
+    std::vector<int> from;
+    std::vector<int> discovered;
+    fillDepressions(graph, height, outlet, level, globals.filledHeight, from, discovered);
+
+    std::vector<char> wet(n);
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        wet[i] = !outlet[i] && level[i] > height[i];
+        map[i].lakeBool = wet[i] != 0;
+    }
+    Components lake_parts;
+    labelComponents(graph, wet, points, lake_parts);
+
+    globals.lakes.assign(lake_parts.count(), Lake());
+    globals.lakeCells.clear();
+    for (int i = 0; i < n; i++)
+    {
+        map[i].lake = lake_parts.id[i];
+        if (!wet[i]) { continue; }
+        Lake& lake = globals.lakes[lake_parts.id[i]];
+        lake.level = level[i];
+        lake.maxDepth = std::max(lake.maxDepth, level[i] - height[i]);
+        globals.lakeCells.push_back(i);
+    }
+    for (int c = 0; c < lake_parts.count(); c++)
+    {
+        globals.lakes[c].numCells = lake_parts.size[c];
+        globals.lakes[c].bounds = lake_parts.bounds[c];
+    }
+    // The flood enters every lake over its spill point, the first lake cell reached tells which one it is
+    for (int cell : discovered)
+    {
+        if (!wet[cell] || wet[from[cell]]) { continue; }
+        Lake& lake = globals.lakes[lake_parts.id[cell]];
+        if (lake.spill < 0) { lake.spill = from[cell]; }
+    }
+}
+
+// Split the river cells of a flow graph into River objects in one pass over the levels
+// Strahler order and Shreve magnitude are pulled from the river donors from the sources down, a river starts at every cell
+// that does not have exactly one river donor, and its cells are found by following the receivers, counted first so
+// every river gets its own range of riverPath and the ranges are filled in parallel
+void buildRivers(std::vector<Cell>& map, const FlowGraph& flow, const std::vector<float>& drainage, GlobalWorldObjects& globals)
+{
+    const int n = flow.size();
+    std::vector<int> strahler(n, 0);
+    std::vector<int> shreve(n, 0);
+    std::vector<int> river_donors(n, 0);
+    for (int l = flow.levels() - 1; l >= 0; l--)
+    {
+        const int first = flow.levelOffsets[l];
+        const int last = flow.levelOffsets[l + 1];
+        #pragma omp parallel for schedule(static) if(last - first >= FLOW_PARALLEL_LEVEL)
+        for (int k = first; k < last; k++)
+        {
+            const int i = flow.order[k];
+            if (!map[i].riverBool) { continue; }
+            int highest = 0;
+            int highest_count = 0;
+            int magnitude = 0;
+            int donors = 0;
+            for (int d = flow.donorOffsets[i]; d < flow.donorOffsets[i + 1]; d++)
+            {
+                const int donor = flow.donors[d];
+                if (!map[donor].riverBool) { continue; }
+                donors++;
+                magnitude += shreve[donor];
+                if (strahler[donor] > highest) { highest = strahler[donor]; highest_count = 1; }
+                else if (strahler[donor] == highest) { highest_count++; }
+            }
+            river_donors[i] = donors;
+            strahler[i] = donors == 0 ? 1 : highest + (highest_count >= 2 ? 1 : 0);
+            shreve[i] = donors == 0 ? 1 : magnitude;
+        }
+    }
+
+    std::vector<int> heads;
+    for (int i = 0; i < n; i++)
+    {
+        if (map[i].riverBool && river_donors[i] != 1) { heads.push_back(i); }
+    }
+    const int count = static_cast<int>(heads.size());
+
+    // A river runs down while the next cell is a river cell that only this river feeds, plus the cell it ends in
+    // A pit is its own receiver, a river that reaches one ends in it (only possible on a surface that is not filled)
+    std::vector<int> offsets(count + 1, 0);
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (int r = 0; r < count; r++)
+    {
+        int cell = heads[r];
+        int length = 1;
+        while (flow.receiver[cell] != cell && map[flow.receiver[cell]].riverBool && river_donors[flow.receiver[cell]] == 1)
+        {
+            cell = flow.receiver[cell];
+            length++;
+        }
+        if (flow.receiver[cell] != cell) { length++; }
+        offsets[r + 1] = length;
+    }
+    for (int r = 0; r < count; r++)
+    {
+        offsets[r + 1] += offsets[r];
+    }
+
+    globals.rivers.assign(count, River());
+    globals.riverPath.resize(offsets[count]);
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (int r = 0; r < count; r++)
+    {
+        River& river = globals.rivers[r];
+        river.first = offsets[r];
+        river.count = offsets[r + 1] - offsets[r];
+        river.strahler = strahler[heads[r]];
+        river.shreve = shreve[heads[r]];
+        int cell = heads[r];
+        for (int k = 0; k + 1 < river.count; k++)
+        {
+            globals.riverPath[river.first + k] = cell;
+            map[cell].river = r;
+            river.len += flow.receiverLength[cell];
+            cell = flow.receiver[cell];
+        }
+        globals.riverPath[river.first + river.count - 1] = cell;
+        // The end cell belongs to the river below or the sea, unless the river stops in a pit
+        const bool pit = map[cell].riverBool && flow.receiver[cell] == cell;
+        if (pit) { map[cell].river = r; }
+
+        // Leopold and Maddock: width ~ Q^0.5, depth ~ Q^0.4, velocity ~ Q^0.1 with the drainage area standing in for Q
+        river.discharge = drainage[globals.riverPath[river.first + river.count - (pit ? 1 : 2)]];
+        river.maxWidth = std::sqrt(river.discharge);
+        river.maxDepth = std::pow(river.discharge, 0.4f);
+        river.flowSpeed = std::pow(river.discharge, 0.1f);
+    }
+
+    // A confluence is the first cell of the river below it
+    #pragma omp parallel for schedule(static)
+    for (int r = 0; r < count; r++)
+    {
+        const int end = globals.riverPath[globals.rivers[r].first + globals.rivers[r].count - 1];
+        globals.rivers[r].downstream = map[end].riverBool && flow.receiver[end] != end ? map[end].river : -1;
+    }
+}
+
+// Drainage basins: every root of the flow forest that land drains into starts a basin, and the id is handed up the
+// receiver tree one level at a time, so all the independent subtrees are labeled together and each level is split over the threads
+void labelBasins(std::vector<Cell>& map, const CellGraph& graph, const FlowGraph& flow, GlobalWorldObjects& globals)
+{
+    const int n = flow.size();
+    std::vector<int> label(n, -1);
+    globals.basins.clear();
+    for (int k = flow.levelOffsets[0]; k < flow.levelOffsets[1]; k++)
+    {
+        const int root = flow.order[k];
+        if (map[root].oceanBool && flow.donorOffsets[root] == flow.donorOffsets[root + 1]) { continue; }
+        label[root] = static_cast<int>(globals.basins.size());
+        Basin basin;
+        basin.outlet = root;
+        globals.basins.push_back(basin);
+    }
+    for (int l = 1; l < flow.levels(); l++)
+    {
+        const int first = flow.levelOffsets[l];
+        const int last = flow.levelOffsets[l + 1];
+        #pragma omp parallel for schedule(static) if(last - first >= FLOW_PARALLEL_LEVEL)
+        for (int k = first; k < last; k++)
+        {
+            const int i = flow.order[k];
+            label[i] = label[flow.receiver[i]];
+        }
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        map[i].basin = map[i].oceanBool ? -1 : label[i];
+    }
+    for (int i = 0; i < n; i++)
+    {
+        if (map[i].basin < 0) { continue; }
+        globals.basins[map[i].basin].area += graph.area[i];
+        globals.basins[map[i].basin].numCells++;
+    }
+}
+
+struct RiverSettings
+{
+    float minDrainage = 100.f; // Drainage area (in mean cells) where a river starts
+};
+
+// Rivers from the flow of the current heightmap: every land cell drains to its steepest lower neighbor,
+// the drainage area is accumulated downstream and cells that collect enough of it carry a river
+// The flow runs over the filled surface, so it passes through the lakes instead of stopping in them and the land has no pits
+// The surface of calcLakes is reused, without it the depressions are filled here (and no lakes are marked)
+// riverStr grows from 0 at the threshold towards 1 for the biggest rivers
+void calcRivers(std::vector<Cell>& map, const CellGraph& graph, GlobalWorldObjects& globals, const RiverSettings& settings = RiverSettings())
+{
+    const int n = graph.size();
+    std::vector<char> outlet(n);
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        outlet[i] = graph.border[i] || map[i].oceanBool;
+    }
+    std::vector<float> height;
+    if (static_cast<int>(globals.filledHeight.size()) == n) { height = globals.filledHeight; }
+    else
+    {
+        std::vector<float> raw;
+        std::vector<float> level;
+        std::vector<int> from;
+        std::vector<int> discovered;
+        gatherField(map, raw, &Cell::height);
+        fillDepressions(graph, raw, outlet, level, height, from, discovered);
+    }
+
+    FlowGraph flow;
+    computeReceivers(graph, height, outlet, flow);
+    buildFlowOrder(flow);
+    std::vector<float> cell_area;
+    std::vector<float> drainage;
+    meanCellAreas(graph, cell_area);
+    accumulateFlow(flow, cell_area, drainage);
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        const bool river = !outlet[i] && !map[i].lakeBool && drainage[i] >= settings.minDrainage;
+        map[i].riverBool = river;
+        map[i].riverStr = river ? 1.f - settings.minDrainage / drainage[i] : 0.f;
+        map[i].river = -1;
+    }
+    buildRivers(map, flow, drainage, globals);
+    labelBasins(map, graph, flow, globals);
+
+    globals.riverCells.clear();
+    for (int i = 0; i < n; i++)
+    {
+        if (map[i].riverBool) { globals.riverCells.push_back(i); }
+    }
+}
@@ -5,6 +5,9 @@
 #include <cstdlib>
 #include <chrono>
 #include "Voronoi.hpp"
+#include "hydrology.hpp"
+#include "tectonics.hpp"
+#include "solver.hpp"
 #include "vertex.hpp"
 
 #include "imgui.h"
@@ -38,6 +41,7 @@ static void genWorld(vor::Voronoi& map, GlobalWorldObjects& globals, sf::RenderW
     const float& point_jitter, 
     const unsigned int& npeaks,
     const float& sealevel,
+    const float& target_land,
     const float& global_temp_avg,
     const float& delta_max_neg,
     const float& delta_max_pos,
@@ -48,8 +52,15 @@ static void genWorld(vor::Voronoi& map, GlobalWorldObjects& globals, sf::RenderW
     const unsigned int& height_smooth_repeats,
     const int& smooth_method,
     const unsigned int& height_noise_repeats,
+    const int& noise_method,
+    const unsigned int& erosion_iterations,
+    const unsigned int& n_plates,
+    const float& river_threshold,
     const float& delta_coast_line,
     const unsigned int& temp_smooth_repeats,
+    const int& climate_smooth_method,
+    const int& percepitation_method,
+    const unsigned int& percepitation_sweeps,
     const unsigned int& percepitation_repeats,
     const unsigned int& percepitation_smooth_repeats,
     const unsigned int& kmeans_max_iter,
@@ -107,25 +118,74 @@ static void genWorld(vor::Voronoi& map, GlobalWorldObjects& globals, sf::RenderW
 
     start = std::chrono::high_resolution_clock::now();
     loadText(window, text, 50, loadingText, "Generating Heightmap");
-    random_height_gen(map.cells, npeaks, delta_max_neg, delta_max_pos, prob_of_island, dist_from_mainland, height_method);
+    if (height_method == 3) {
+        parallel_height_gen(map.cells, map.graph, rand(), npeaks, delta_max_neg, delta_max_pos, prob_of_island, dist_from_mainland);
+    }
+    else if (height_method == 4 || height_method == 5) {
+        NoiseSettings settings;
+        settings.type = height_method == 5 ? 1 : 0;
+        settings.warp = 120.f;
+        noise_height_gen(map.cells, map.graph, map.points, rand(), settings);
+    }
+    else {
+        random_height_gen(map.cells, npeaks, delta_max_neg, delta_max_pos, prob_of_island, dist_from_mainland, height_method);
+    }
+    if (n_plates > 0) {
+        std::vector<Plate> plates;
+        PlateSettings plateSettings;
+        plateSettings.plates = n_plates;
+        plate_height_gen(map.cells, map.graph, map.points, rand(), plates, plateSettings);
+    }
     end = std::chrono::high_resolution_clock::now();
     duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
     std::cout << "Height Gen took: " << duration.count() << "ms" << std::endl;
 
     start = std::chrono::high_resolution_clock::now();
     loadText(window, text, 50, loadingText, "Smoothing Heightmap");
-    smooth_height(map.cells, rise_threshold, height_smooth_repeats, smooth_method);
+    if (smooth_method == 3) {
+        parallel_smooth_height(map.cells, map.graph, rise_threshold, height_smooth_repeats);
+    }
+    else {
+        smooth_height(map.cells, rise_threshold, height_smooth_repeats, smooth_method);
+    }
     end = std::chrono::high_resolution_clock::now();
     duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
     std::cout << "Smooth Height took: " << duration.count() << "ms" << std::endl;
 
     start = std::chrono::high_resolution_clock::now();
     loadText(window, text, 50, loadingText, "Adding Noise to Heightmap");
-    noise_height(map.cells, height_noise_repeats);
+    if (noise_method == 2) {
+        noise_height(map.cells, map.points, height_noise_repeats, rand());
+    }
+    else {
+        noise_height(map.cells, height_noise_repeats);
+    }
     end = std::chrono::high_resolution_clock::now();
     duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
     std::cout << "Noise Height took: " << duration.count() << "ms" << std::endl;
 
+    // Sea level from the wanted land fraction, before the erosion this is only the base level the rivers drain into
+    if (target_land > 0.f) {
+        globals.setSeaLevel(seaLevelFromLandFraction(map.cells, target_land));
+    }
+
+    if (erosion_iterations > 0) {
+        start = std::chrono::high_resolution_clock::now();
+        loadText(window, text, 50, loadingText, "Eroding Heightmap");
+        ErosionSettings erosion;
+        erosion.iterations = erosion_iterations;
+        erodeStreamPower(map.cells, map.graph, globals, erosion);
+        end = std::chrono::high_resolution_clock::now();
+        duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+        std::cout << "Erosion took: " << duration.count() << "ms" << std::endl;
+    }
+
+    // Erosion lowers land below the base level, so the final level is picked from the eroded heights
+    if (target_land > 0.f) {
+        globals.setSeaLevel(seaLevelFromLandFraction(map.cells, target_land));
+        std::cout << "Sea level for " << target_land * 100.f << "% land: " << globals.seaLevel << std::endl;
+    }
+
     start = std::chrono::high_resolution_clock::now();
     loadText(window, text, 50, loadingText, "Calculating Height Values");
     calcHeightValues(map.cells, globals, delta_coast_line);
@@ -135,21 +195,37 @@ static void genWorld(vor::Voronoi& map, GlobalWorldObjects& globals, sf::RenderW
 
     start = std::chrono::high_resolution_clock::now();
     loadText(window, text, 50, loadingText, "Distance To Oceans");
-    closeOceanCell(map.cells, map.points, globals);
+    closeOceanCell(map.cells, map.graph);
     end = std::chrono::high_resolution_clock::now();
     duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
     std::cout << "Dist to Ocean took: " << duration.count() << "ms" << std::endl;
 
+    start = std::chrono::high_resolution_clock::now();
+    loadText(window, text, 50, loadingText, "Finding Landmasses");
+    updateComponents(map.cells, map.graph, map.points, globals);
+    end = std::chrono::high_resolution_clock::now();
+    duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+    std::cout << "Landmasses took: " << duration.count() << "ms (" << globals.landmasses.count() << " land, " << globals.waterBodies.count() << " water)" << std::endl;
+
     start = std::chrono::high_resolution_clock::now();
     loadText(window, text, 50, loadingText, "Calculating Wind");
-    calcWind(map.cells, map.points, MAXHEIGHT, globals);
+    calcWind(map.cells, map.graph, map.points, MAXHEIGHT, globals, rand());
     end = std::chrono::high_resolution_clock::now();
     duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
     std::cout << "Wind Calc took: " << duration.count() << "ms" << std::endl;
 
+    start = std::chrono::high_resolution_clock::now();
+    loadText(window, text, 50, loadingText, "Calculating Lakes");
+    calcLakes(map.cells, map.graph, map.points, globals);
+    end = std::chrono::high_resolution_clock::now();
+    duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+    std::cout << "Lakes took: " << duration.count() << "ms (" << globals.lakes.size() << " lakes)" << std::endl;
+
     start = std::chrono::high_resolution_clock::now();
     loadText(window, text, 50, loadingText, "Calculating River");
-    calcRiverStart(map.cells, globals);
+    RiverSettings rivers;
+    rivers.minDrainage = river_threshold;
+    calcRivers(map.cells, map.graph, globals, rivers);
     end = std::chrono::high_resolution_clock::now();
     duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
     std::cout << "Rivers took: " << duration.count() << "ms" << std::endl;
@@ -157,29 +233,60 @@ static void genWorld(vor::Voronoi& map, GlobalWorldObjects& globals, sf::RenderW
     start = std::chrono::high_resolution_clock::now();
     loadText(window, text, 50, loadingText, "Calculating Temperatures");
     calcTemp(map.cells, globals, map.points, MAXHEIGHT);
-    smoothTemps(map.cells, temp_smooth_repeats);
+    calcCurrents(map.cells, map.graph, map.points, MAXHEIGHT, globals);
+    if (climate_smooth_method >= 2) {
+        SolverSettings solver;
+        solver.multigrid = climate_smooth_method == 3;
+        SolverStats stats = diffuseFields(map.cells, map.graph, { &Cell::temp }, static_cast<float>(temp_smooth_repeats), solver);
+        std::cout << "Temperature diffusion: " << stats.iterations << " iterations" << std::endl;
+    }
+    else {
+        smoothTemps(map.cells, map.graph, temp_smooth_repeats);
+    }
     end = std::chrono::high_resolution_clock::now();
     duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
     std::cout << "Temperature took: " << duration.count() << "ms" << std::endl;
 
     start = std::chrono::high_resolution_clock::now();
     loadText(window, text, 50, loadingText, "Calculating Percepetation");
-    calcPercepitation(map.cells, map.points, globals, percepitation_repeats);
-    smoothPercepitation(map.cells, percepitation_smooth_repeats); 
+    if (percepitation_method == 2) {
+        PercepitationSettings percepitation;
+        percepitation.sweeps = percepitation_sweeps;
+        calcPercepitationSweep(map.cells, map.graph, map.points, globals, percepitation);
+    }
+    else {
+        calcPercepitation(map.cells, map.graph, globals, percepitation_repeats);
+    }
+    if (climate_smooth_method >= 2) {
+        SolverSettings solver;
+        solver.multigrid = climate_smooth_method == 3;
+        SolverStats stats = diffuseFields(map.cells, map.graph, { &Cell::percepitation }, static_cast<float>(percepitation_smooth_repeats), solver);
+        std::cout << "Percepitation diffusion: " << stats.iterations << " iterations" << std::endl;
+    }
+    else {
+        smoothPercepitation(map.cells, map.graph, percepitation_smooth_repeats);
+    }
     end = std::chrono::high_resolution_clock::now();
     duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
     std::cout << "Percepitatiton took: " << duration.count() << "ms" << std::endl;
 
     start = std::chrono::high_resolution_clock::now();
-    loadText(window, text, 50, loadingText, "Calculating Humidity");
-    calcHumid(map.cells);
+    loadText(window, text, 50, loadingText, "Calculating Humidity, Snow and Ice");
+    calcClimate(map.cells, globals);
     end = std::chrono::high_resolution_clock::now();
     duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
-    std::cout << "Humidity took: " << duration.count() << "ms" << std::endl;
+    std::cout << "Climate took: " << duration.count() << "ms" << std::endl;
+
+    start = std::chrono::high_resolution_clock::now();
+    loadText(window, text, 50, loadingText, "Calculating Seasons");
+    calcSeasons(map.cells, globals, map.points, MAXHEIGHT);
+    end = std::chrono::high_resolution_clock::now();
+    duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+    std::cout << "Seasons took: " << duration.count() << "ms" << std::endl;
 
     start = std::chrono::high_resolution_clock::now();
     loadText(window, text, 50, loadingText, "Calculating Biomes");
-    calcBiome(map.cells, globals, kmeans_max_iter, biome_method);
+    calcBiome(map.cells, map.graph, globals, kmeans_max_iter, biome_method);
     end = std::chrono::high_resolution_clock::now();
     duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
     std::cout << "Biomes took: " << duration.count() << "ms" << std::endl;
@@ -218,10 +325,12 @@ static sf::VertexArray drawHighlightCell(vor::Voronoi& map, std::size_t cell)
     return highlight;
 }
 
-static void drawTempMap(vor::Voronoi& map, VertexMap& vertexMap) {
+// month -1 draws the yearly values, otherwise the seasonal tables
+static void drawTempMap(vor::Voronoi& map, VertexMap& vertexMap, const GlobalWorldObjects& globals, int month = -1) {
     for (size_t i = 0; i < map.cells.size(); i++)
     {
-        sf::Color color(255, 255 / 2 + clamp(5 * map.cells[i].temp, 255 / 2, -255), 0, 255);
+        const float temp = month >= 0 && month < globals.months ? globals.getMonthTemp(i, month) : map.cells[i].temp;
+        sf::Color color(255, 255 / 2 + clamp(5 * temp, 255 / 2, -255), 0, 255);
 
         for (size_t j = map.cells[i].vertex_offset; j < map.cells[i].vertex_offset + map.cells[i].vertex.size() * 3; j++)
         {
@@ -244,11 +353,12 @@ static void drawBiomeMap(vor::Voronoi& map, GlobalWorldObjects globals, VertexMa
     vertexMap.update(map);
 }
 
-static void drawPercepitationMap(vor::Voronoi& map, VertexMap& vertexMap)
+static void drawPercepitationMap(vor::Voronoi& map, VertexMap& vertexMap, const GlobalWorldObjects& globals, int month = -1)
 {
     for (size_t i = 0; i < map.cells.size(); i++)
     {
-        sf::Color color(0, clamp(5 * map.cells[i].percepitation, 255, 0), 0, 255);
+        const float percepitation = month >= 0 && month < globals.months ? globals.getMonthPercepitation(i, month) : map.cells[i].percepitation;
+        sf::Color color(0, clamp(5 * percepitation, 255, 0), 0, 255);
 
         for (size_t j = map.cells[i].vertex_offset; j < map.cells[i].vertex_offset + map.cells[i].vertex.size() * 3; j++)
         {
@@ -261,7 +371,7 @@ static void drawPercepitationMap(vor::Voronoi& map, VertexMap& vertexMap)
 static void drawHeightMap(vor::Voronoi& map, VertexMap& vertexMap)
 {
     for (std::size_t i = 0; i < map.cells.size(); i++) {
-        sf::Color color((128 * (1 - map.cells[i].oceanBool)), (255 * (1 - map.cells[i].oceanBool)), 255 / 3 * (map.cells[i].oceanBool + (2 - map.cells[i].riverBool - map.cells[i].lakeBool)), 55 + (sf::Uint8)std::abs(std::ceil(200 * map.cells[i].height)));
+        sf::Color color = heightColor(map.cells[i]);
         for (size_t j = map.cells[i].vertex_offset; j < map.cells[i].vertex_offset + map.cells[i].vertex.size() * 3; j++) {
             map.vertices[j].color = color;
         }
@@ -301,22 +411,30 @@ int main()
     float delta_max_pos = 0.02; // The maximum amount of random height added in the positive direction
     float prob_of_island = 0.01; // small probability of random height increase when away from mainland 
     float dist_from_mainland = 1.0; // The distance from the mainland where the probability of random height increase begins, Represented by the sum of height of all neighbors
-    int height_method = 1; // Method 1 is random, method 2 is first in first out, needs more methods (Simplex, diamond, perlin, etc)
+    int height_method = 1; // Method 1 is random, method 2 is first in first out, method 3 grows all peaks in parallel, method 4 is fBm noise, method 5 is ridged noise
     float rise_threshold = 0.09; // The minimum rise value where a cell height is smoothed 
     unsigned int height_smooth_repeats = 15; // amount of height smoothing iterations
-    int smooth_method = 1; // method 1 is random the other is front
+    int smooth_method = 1; // method 1 is random, method 2 is front, method 3 is a parallel Jacobi sweep
     unsigned int height_noise_repeats = 2; // amount of height noise iterations, happens after smoothing
+    int noise_method = 1; // method 1 is repeated white noise, method 2 is a single pass of coherent noise with the same amplitude
+    unsigned int erosion_iterations = 0; // amount of stream power erosion steps after the noise, 0 turns erosion off
+    unsigned int n_plates = 0; // amount of tectonic plates blended into the heightmap as a base layer, 0 turns plates off
+    float river_threshold = 100.f; // drainage area (in average cells) a cell needs to carry a river
     float delta_coast_line = 0.05; // the range around sealevel that is considered coast (below and above)
 
     // Temperature
     float global_temp_avg = RandomBetween(25.f, 45.f); // not the actual average but a value that determines the temperature range
     unsigned int temp_smooth_repeats = 2; // amount of temperature smoothing iterations
+    int climate_smooth_method = 1; // method 1 repeats neighbor averages, method 2 solves one diffusion step with CG, method 3 adds multigrid
 
     // Sealevel
     float sealevel = RandomBetween(0.4f, 0.6f); // The height at which the ocean starts
+    float target_land = 0.f; // Fraction of the cells that should be land, overrides sealevel when above 0
     
     // Percepitation
-    unsigned int percepitation_repeats = 1; // amount of percepitation iterations (NEEDs to be above 1)
+    int percepitation_method = 2; // method 1 is a random flood from the oceans, method 2 sweeps the cells in upwind order
+    unsigned int percepitation_sweeps = 2; // upwind sweeps for method 2, the second repairs cells where a wind cycle was cut
+    unsigned int percepitation_repeats = 1; // amount of percepitation iterations for method 1 (at least 1)
     unsigned int percepitation_smooth_repeats = 2; // amount of percepitation smoothing iterations
     
     // Biomes
@@ -364,6 +482,7 @@ int main()
     bool wind = false; // Set to true to draw the wind direction
     bool highlightBool = false; // Set to true to highlight a cell
     int mapType = 0; int mapTypeOld = 0;
+    int month = 0; // Month shown on the temperature and percepitation maps, 0 is the yearly value
     bool newMap = false; // Get window to draw new map
     bool biomeGen = false; // Get window to regenerate biomes
 
@@ -379,14 +498,14 @@ int main()
         n_convergence_lines,
         n_biomes, ncellx, ncelly,
         windowWidth, windowHeight,
-        point_jitter, npeaks, sealevel,
+        point_jitter, npeaks, sealevel, target_land,
         global_temp_avg, delta_max_neg,
         delta_max_pos, prob_of_island,
         dist_from_mainland, height_method,
         rise_threshold, height_smooth_repeats,
-        smooth_method, height_noise_repeats,
-        delta_coast_line, temp_smooth_repeats,
-        percepitation_repeats, percepitation_smooth_repeats,
+        smooth_method, height_noise_repeats, noise_method, erosion_iterations, n_plates, river_threshold,
+        delta_coast_line, temp_smooth_repeats, climate_smooth_method,
+        percepitation_method, percepitation_sweeps, percepitation_repeats, percepitation_smooth_repeats,
         kmeans_max_iter, windstr_alpha, windstr_beta,biome_method, seed);
 
     while (window.isOpen())
@@ -436,14 +555,14 @@ int main()
                         n_convergence_lines,
                         n_biomes, ncellx, ncelly,
                         windowWidth, windowHeight,
-                        point_jitter, npeaks, sealevel,
+                        point_jitter, npeaks, sealevel, target_land,
                         global_temp_avg, delta_max_neg,
                         delta_max_pos, prob_of_island,
                         dist_from_mainland, height_method,
                         rise_threshold, height_smooth_repeats,
-                        smooth_method, height_noise_repeats,
-                        delta_coast_line, temp_smooth_repeats,
-                        percepitation_repeats, percepitation_smooth_repeats,
+                        smooth_method, height_noise_repeats, noise_method, erosion_iterations, n_plates, river_threshold,
+                        delta_coast_line, temp_smooth_repeats, climate_smooth_method,
+                        percepitation_method, percepitation_sweeps, percepitation_repeats, percepitation_smooth_repeats,
                         kmeans_max_iter, windstr_alpha, windstr_beta, biome_method, seed);
                 }
 
@@ -606,7 +725,7 @@ int main()
                 wind = false;
 				break;
 			case 1:
-				drawTempMap(map, vertexMap);
+				drawTempMap(map, vertexMap, globals, month - 1);
                 wind = false;
 				break;
 			case 2:
@@ -614,7 +733,7 @@ int main()
                 wind = false;
 				break;
 			case 3:
-				drawPercepitationMap(map, vertexMap);
+				drawPercepitationMap(map, vertexMap, globals, month - 1);
                 wind = false;
 				break;
             case 4:
@@ -624,6 +743,15 @@ int main()
 			}
 		}
 
+        if (ImGui::SliderInt("Month", &month, 0, globals.months, month == 0 ? "Year" : "%d")) {
+            if (mapType == 1) { drawTempMap(map, vertexMap, globals, month - 1); }
+            if (mapType == 3) { drawPercepitationMap(map, vertexMap, globals, month - 1); }
+        }
+        if (ImGui::IsItemHovered()) {
+            ImGui::BeginTooltip();
+            ImGui::Text("Shows the temperature and percepitation of one month, 'Year' shows the yearly values.");
+            ImGui::EndTooltip(); }
+
         ImGui::Checkbox("Draw Lines", &drawLines);
         ImGui::Checkbox("Wind Arrows", &wind);
         ImGui::Checkbox("Highlight Cells", &highlightBool);
@@ -631,7 +759,17 @@ int main()
 
         ImGui::Text("Number of cells: %d", map.cells.size());
         ImGui::Text("Number of biomes: %d", globals.biomes.size());
-        ImGui::Text("Sealevel: %.2f", globals.seaLevel);
+        float live_sealevel = globals.seaLevel;
+        if (ImGui::SliderFloat("Sealevel", &live_sealevel, 0.0f, 1.0f)) {
+            // Only the cells between the old and the new level are touched, climate, biomes and rivers are not recomputed
+            std::vector<int> changed;
+            updateSeaLevel(map.cells, map.graph, globals, live_sealevel, changed);
+            if (mapType == 0) { vertexMap.updateCells(map, changed); }
+        }
+        if (ImGui::IsItemHovered()) {
+            ImGui::BeginTooltip();
+            ImGui::Text("Moves the sea level of the current map, updates ocean, coast and distance to ocean. \nFlooded rivers, lakes and basins are removed, new land gets no rivers. \nClimate, biomes and hydrology keep their values until the map is regenerated.");
+            ImGui::EndTooltip(); }
         ImGui::Text("Global Temperature: %.2f", globals.globalTempAvg);
         ImGui::Text("Global Precipitation: %.2f", globals.globalPercepitation);
         ImGui::Text("Global Snow Line: %.2f", globals.globalSnowline);
@@ -642,12 +780,36 @@ int main()
 			const Cell& cell = map.cells[highlightedCell];
 			ImGui::Text("Cell %d", highlightedCell);
 			ImGui::Text("Temp: %.2f", cell.temp);
+            if (globals.months > 0) {
+                float coldest = globals.getMonthTemp(highlightedCell, 0);
+                float warmest = coldest;
+                for (int m = 1; m < globals.months; m++) {
+                    coldest = std::min(coldest, globals.getMonthTemp(highlightedCell, m));
+                    warmest = std::max(warmest, globals.getMonthTemp(highlightedCell, m));
+                }
+                ImGui::Text("Seasons: %.1f to %.1f", coldest, warmest);
+            }
             ImGui::Text("Precipitation: %.2f", cell.percepitation);
             ImGui::Text("Elevation: %.2f", cell.height); ImGui::SameLine();
             ImGui::Text("Rise: %.2f", cell.rise);
             ImGui::Text("Distance to Ocean: %.2f", cell.distToOcean);
             ImGui::Text("Coast Cell: %.d", cell.coastBool);
             ImGui::Text("Ocean Cell: %.d", cell.oceanBool);
+            if (cell.oceanBool) {
+                ImGui::Text("Current: %.2f px/step towards %.0f degrees", std::sqrt(cell.currentX * cell.currentX + cell.currentY * cell.currentY), normalizeAngle(std::atan2(cell.currentY, cell.currentX) * 180.f / PI));
+            }
+            updateComponents(map.cells, map.graph, map.points, globals); // Only does work after the sea level was moved
+            const Components& components = cell.oceanBool ? globals.waterBodies : globals.landmasses;
+            const int component = components.id[highlightedCell];
+            ImGui::Text("%s %d of %d: %d cells", cell.oceanBool ? "Water body" : "Landmass", component, components.count(), components.size[component]);
+            if (cell.basin >= 0) {
+                const Basin& basin = globals.basins[cell.basin];
+                ImGui::Text("Basin %d: %d cells, drains at cell %d", cell.basin, basin.numCells, basin.outlet);
+            }
+            if (cell.river >= 0) {
+                const River& river = globals.rivers[cell.river];
+                ImGui::Text("River %d: Strahler %d, Shreve %d, %.0f px long", cell.river, river.strahler, river.shreve, river.len);
+            }
             const Biome& biome = globals.biomes[cell.biome];
             ImVec4 color = ImVec4(biome.color.r / 255.0f, biome.color.g / 255.0f, biome.color.b / 255.0f, 1.0f);
             ImGui::Text("Biome: %s", biome.name.c_str());
@@ -742,7 +904,7 @@ int main()
                     globals.addBiome("Biome" + std::to_string(i), biomeColors[i]);
                 }
                 biomeColors.clear();
-				calcBiome(map.cells, globals, kmeans_max_iter, biome_method, prob_smoothing);
+				calcBiome(map.cells, map.graph, globals, kmeans_max_iter, biome_method, prob_smoothing);
 			}
             ImGui::PushItemWidth(150.f);
             ImGui::InputUInt("KMeans Max Iterations", &kmeans_max_iter);
@@ -783,14 +945,14 @@ int main()
                     n_convergence_lines,
                     n_biomes, ncellx, ncelly,
                     windowWidth, windowHeight,
-                    point_jitter, npeaks, sealevel,
+                    point_jitter, npeaks, sealevel, target_land,
                     global_temp_avg, delta_max_neg,
                     delta_max_pos, prob_of_island,
                     dist_from_mainland, height_method,
                     rise_threshold, height_smooth_repeats,
-                    smooth_method, height_noise_repeats,
-                    delta_coast_line, temp_smooth_repeats,
-                    percepitation_repeats, percepitation_smooth_repeats,
+                    smooth_method, height_noise_repeats, noise_method, erosion_iterations, n_plates, river_threshold,
+                    delta_coast_line, temp_smooth_repeats, climate_smooth_method,
+                    percepitation_method, percepitation_sweeps, percepitation_repeats, percepitation_smooth_repeats,
                     kmeans_max_iter, windstr_alpha, windstr_beta, biome_method ,seed);
                 newMap = false;
             }
@@ -823,6 +985,12 @@ int main()
                 ImGui::Text("The height of the sealevel across map, between 0 and 1.");
                 ImGui::EndTooltip(); }
 
+            ImGui::DragFloat("Target Land", &target_land, 0.01f, 0.0f, 1.0f);
+            if (ImGui::IsItemHovered()) {
+                ImGui::BeginTooltip();
+                ImGui::Text("Fraction of the map that should be land, the sea level is picked to match it. \n0 uses the Sea Level above instead.");
+                ImGui::EndTooltip(); }
+
             ImGui::DragFloat("Global Temp Avg", &global_temp_avg, 0.5f, -30.0f, 100.0f);
             if (ImGui::IsItemHovered()) {
 				ImGui::BeginTooltip();
@@ -859,6 +1027,24 @@ int main()
                 ImGui::Text("This is the amount of times the height values are renoised after the smoothing, \nthis gives a more realistic height map. \nShould not be used more times than smoothing.");
                 ImGui::EndTooltip(); }
 
+            ImGui::InputUInt("Tectonic Plates", &n_plates);
+            if (ImGui::IsItemHovered()) {
+                ImGui::BeginTooltip();
+                ImGui::Text("Amount of tectonic plates blended into the heightmap, at most 255. \nMountains form where plates collide and rifts where they split, 0 turns it off.");
+                ImGui::EndTooltip(); }
+
+            ImGui::InputUInt("Erosion Steps", &erosion_iterations);
+            if (ImGui::IsItemHovered()) {
+                ImGui::BeginTooltip();
+                ImGui::Text("Amount of stream power erosion steps, carves valleys along the drainage. \nA few hundred gives clear river valleys, 0 turns it off.");
+                ImGui::EndTooltip(); }
+
+            ImGui::DragFloat("River Threshold", &river_threshold, 1.f, 1.f, 10000.f);
+            if (ImGui::IsItemHovered()) {
+                ImGui::BeginTooltip();
+                ImGui::Text("Area that has to drain through a cell before it carries a river, in average cells. \nLower values give more and smaller rivers.");
+                ImGui::EndTooltip(); }
+
             ImGui::InputUInt("Temp Smooths", &temp_smooth_repeats);
             if (ImGui::IsItemHovered()) {
                 ImGui::BeginTooltip();
@@ -868,10 +1054,17 @@ int main()
             ImGui::InputUInt("Percepitations", &percepitation_repeats);
             if (ImGui::IsItemHovered()) {
                 ImGui::BeginTooltip();
-                ImGui::Text("This is the amount of times percepitation is calculated. \nShould not be more than 1 unless you want high contrast.");
+                ImGui::Text("This is the amount of times percepitation is calculated with the random flood. \nShould not be more than 1 unless you want high contrast.");
                 ImGui::EndTooltip(); }
             if (percepitation_repeats == 0) { percepitation_repeats = 1; }
 
+            ImGui::InputUInt("Percepitation Sweeps", &percepitation_sweeps);
+            if (ImGui::IsItemHovered()) {
+                ImGui::BeginTooltip();
+                ImGui::Text("This is the amount of upwind sweeps. \n2 also fixes the cells where the wind goes in circles.");
+                ImGui::EndTooltip(); }
+            if (percepitation_sweeps == 0) { percepitation_sweeps = 1; }
+
             ImGui::InputUInt("Percepitation Smooths", &percepitation_smooth_repeats);
             if (ImGui::IsItemHovered()) {
                 ImGui::BeginTooltip();
@@ -908,6 +1101,31 @@ int main()
                     ImGui::BeginTooltip();
                     ImGui::Text("The distance from the mainland where the probability of random height increase begins,\n Represented by the sum of height of all neighbors");
                     ImGui::EndTooltip(); }
+                ImGui::InputInt("Height Method", &height_method);
+                if (ImGui::IsItemHovered()) {
+                    ImGui::BeginTooltip();
+                    ImGui::Text("1: Random peaks, 2: Peaks first in first out, 3: Peaks grown in parallel, \n4: fBm noise, 5: Ridged noise");
+                    ImGui::EndTooltip(); }
+                ImGui::InputInt("Smooth Method", &smooth_method);
+                if (ImGui::IsItemHovered()) {
+                    ImGui::BeginTooltip();
+                    ImGui::Text("1: Random order, 2: Front order, 3: Parallel sweep");
+                    ImGui::EndTooltip(); }
+                ImGui::InputInt("Noise Method", &noise_method);
+                if (ImGui::IsItemHovered()) {
+                    ImGui::BeginTooltip();
+                    ImGui::Text("1: Repeated white noise, 2: One pass of coherent noise");
+                    ImGui::EndTooltip(); }
+                ImGui::InputInt("Climate Smooth Method", &climate_smooth_method);
+                if (ImGui::IsItemHovered()) {
+                    ImGui::BeginTooltip();
+                    ImGui::Text("1: Repeated neighbor averages, 2: One diffusion step solved with conjugate gradients, \n3: Conjugate gradients with multigrid (for large smoothing amounts)");
+                    ImGui::EndTooltip(); }
+                ImGui::InputInt("Percepitation Method", &percepitation_method);
+                if (ImGui::IsItemHovered()) {
+                    ImGui::BeginTooltip();
+                    ImGui::Text("1: Random flood from the oceans, 2: Sweep along the wind with rain shadows");
+                    ImGui::EndTooltip(); }
                 ImGui::DragFloat("Rise Threshold", &rise_threshold, 0.01f, 0.0f, 1.0f);
                 if (ImGui::IsItemHovered()) {
                     ImGui::BeginTooltip();
@@ -0,0 +1,175 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include <SFML/System/Vector2.hpp>
+#include "util.h"
+
+// Coherent gradient noise (Perlin style) for the height and noise stages
+// Sites are evaluated 8 at a time with fixed width loops the compiler turns into SIMD, and threads split the blocks
+
+constexpr int NOISE_LANES = 8;
+
+struct NoiseSettings
+{
+    int type = 0; // 0 is fBm, 1 is ridged
+    int octaves = 6; // Layers of noise added together
+    float frequency = 0.0017f; // Frequency of the first octave (1 / pixels)
+    float lacunarity = 2.f; // Frequency multiplier between octaves
+    float gain = 0.5f; // Amplitude multiplier between octaves
+    float warp = 0.f; // Domain warp strength in pixels, 0 turns it off
+};
+
+namespace noise {
+
+    // Gradients are the 8 compass directions
+    constexpr float GRAD_X[8] = { 1.f, -1.f, 0.f, 0.f, 0.70710678f, -0.70710678f, 0.70710678f, -0.70710678f };
+    constexpr float GRAD_Y[8] = { 0.f, 0.f, 1.f, -1.f, 0.70710678f, 0.70710678f, -0.70710678f, -0.70710678f };
+
+    inline float fade(float t) { return t * t * t * (t * (t * 6.f - 15.f) + 10.f); }
+
+    inline unsigned int corner_hash(unsigned int seed, int x, int y)
+    {
+        return hash_u32(seed, static_cast<unsigned int>(x) * 0x27D4EB2Du ^ static_cast<unsigned int>(y) * 0x165667B1u) & 7u;
+    }
+
+    // One octave of gradient noise for 8 sites, roughly in [-1, 1]
+    inline void gradient8(const float* x, const float* y, float* out, unsigned int seed)
+    {
+        for (int l = 0; l < NOISE_LANES; l++)
+        {
+            const float fx = std::floor(x[l]);
+            const float fy = std::floor(y[l]);
+            const int ix = static_cast<int>(fx);
+            const int iy = static_cast<int>(fy);
+            const float dx = x[l] - fx;
+            const float dy = y[l] - fy;
+
+            const unsigned int h00 = corner_hash(seed, ix, iy);
+            const unsigned int h10 = corner_hash(seed, ix + 1, iy);
+            const unsigned int h01 = corner_hash(seed, ix, iy + 1);
+            const unsigned int h11 = corner_hash(seed, ix + 1, iy + 1);
+
+            const float n00 = GRAD_X[h00] * dx + GRAD_Y[h00] * dy;
+            const float n10 = GRAD_X[h10] * (dx - 1.f) + GRAD_Y[h10] * dy;
+            const float n01 = GRAD_X[h01] * dx + GRAD_Y[h01] * (dy - 1.f);
+            const float n11 = GRAD_X[h11] * (dx - 1.f) + GRAD_Y[h11] * (dy - 1.f);
+
+            const float u = fade(dx);
+            const float v = fade(dy);
+            const float nx0 = n00 + u * (n10 - n00);
+            const float nx1 = n01 + u * (n11 - n01);
+            out[l] = 1.41421356f * (nx0 + v * (nx1 - nx0));
+        }
+    }
+
+    // Sum of octaves for 8 sites, fBm is in [-1, 1] and ridged is in [0, 1]
+    inline void fractal8(const float* x, const float* y, float* out, const NoiseSettings& settings, unsigned int seed)
+    {
+        float px[NOISE_LANES];
+        float py[NOISE_LANES];
+        float octave[NOISE_LANES];
+        float weight[NOISE_LANES];
+        for (int l = 0; l < NOISE_LANES; l++)
+        {
+            out[l] = 0.f;
+            weight[l] = 1.f;
+        }
+
+        float frequency = settings.frequency;
+        float amplitude = 1.f;
+        float total = 0.f;
+        for (int o = 0; o < settings.octaves; o++)
+        {
+            for (int l = 0; l < NOISE_LANES; l++)
+            {
+                px[l] = x[l] * frequency;
+                py[l] = y[l] * frequency;
+            }
+            gradient8(px, py, octave, seed + o);
+
+            if (settings.type == 1)
+            { // Ridged: sharp crests where the noise crosses zero, each octave is weighted by the one before it
+                for (int l = 0; l < NOISE_LANES; l++)
+                {
+                    float ridge = 1.f - std::abs(octave[l]);
+                    ridge = ridge * ridge * weight[l];
+                    weight[l] = clamp(ridge * 2.f, 1.f, 0.f);
+                    out[l] += ridge * amplitude;
+                }
+            }
+            else
+            {
+                for (int l = 0; l < NOISE_LANES; l++)
+                {
+                    out[l] += octave[l] * amplitude;
+                }
+            }
+            total += amplitude;
+            frequency *= settings.lacunarity;
+            amplitude *= settings.gain;
+        }
+
+        const float inv_total = total > 0.f ? 1.f / total : 0.f;
+        for (int l = 0; l < NOISE_LANES; l++)
+        {
+            out[l] *= inv_total;
+        }
+    }
+
+    // Fractal noise with an optional domain warp, the warp offsets come from two more fBm fields
+    inline void warped8(const float* x, const float* y, float* out, const NoiseSettings& settings, unsigned int seed)
+    {
+        if (settings.warp <= 0.f)
+        {
+            fractal8(x, y, out, settings, seed);
+            return;
+        }
+
+        NoiseSettings warp_settings = settings;
+        warp_settings.type = 0;
+        warp_settings.octaves = std::max(1, settings.octaves / 2);
+
+        float qx[NOISE_LANES];
+        float qy[NOISE_LANES];
+        float wx[NOISE_LANES];
+        float wy[NOISE_LANES];
+        fractal8(x, y, qx, warp_settings, seed + 101);
+        fractal8(x, y, qy, warp_settings, seed + 202);
+        for (int l = 0; l < NOISE_LANES; l++)
+        {
+            wx[l] = x[l] + settings.warp * qx[l];
+            wy[l] = y[l] + settings.warp * qy[l];
+        }
+        fractal8(wx, wy, out, settings, seed);
+    }
+}
+
+// Evaluate the noise at every site, blocks of 8 sites are split over the threads and the last block is padded
+void evaluateNoise(const std::vector<sf::Vector2f>& points, std::vector<float>& out, const NoiseSettings& settings, unsigned int seed)
+{
+    const int n = static_cast<int>(points.size());
+    const int blocks = (n + NOISE_LANES - 1) / NOISE_LANES;
+    out.resize(n);
+
+    #pragma omp parallel for schedule(static)
+    for (int b = 0; b < blocks; b++)
+    {
+        float x[NOISE_LANES];
+        float y[NOISE_LANES];
+        float value[NOISE_LANES];
+        const int first = b * NOISE_LANES;
+        for (int l = 0; l < NOISE_LANES; l++)
+        {
+            const int i = std::min(first + l, n - 1);
+            x[l] = points[i].x;
+            y[l] = points[i].y;
+        }
+
+        noise::warped8(x, y, value, settings, seed);
+
+        for (int l = 0; l < NOISE_LANES && first + l < n; l++)
+        {
+            out[first + l] = value[l];
+        }
+    }
+}
@@ -0,0 +1,363 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <initializer_list>
+#include "graph.hpp"
+#include "util.h"
+
+// Sparse linear solver on the cell graph, for fields that diffuse over the map (temperature, percepitation)
+// One implicit diffusion step (area + t * Laplacian) u = area * f replaces many rounds of neighbor averaging,
+// it is solved with conjugate gradients and a Jacobi or aggregation multigrid preconditioner
+// The Laplacian uses the Voronoi weights (shared side / distance of the sites) so it does not depend on the mesh density
+
+// Symmetric matrix as a diagonal plus the off diagonal entries in CSR layout
+class SparseMatrix
+{
+public:
+    std::vector<int> offsets; // Row i is cols[offsets[i]] up to cols[offsets[i + 1]]
+    std::vector<int> cols;
+    std::vector<float> values;
+    std::vector<float> diag;
+
+    int size() const { return static_cast<int>(diag.size()); }
+
+    // y = A x
+    template <typename T>
+    void multiply(const std::vector<T>& x, std::vector<T>& y) const
+    {
+        const int n = size();
+        y.resize(n);
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            T sum = diag[i] * x[i];
+            for (int j = offsets[i]; j < offsets[i + 1]; j++)
+            {
+                sum += values[j] * x[cols[j]];
+            }
+            y[i] = sum;
+        }
+    }
+};
+
+struct SolverSettings
+{
+    int maxIterations = 100;
+    float tolerance = 1e-4f; // Stop when the residual is this small relative to the right hand side
+    bool multigrid = false; // Aggregation multigrid instead of plain Jacobi as preconditioner
+    int coarseSize = 256; // Multigrid stops coarsening below this many unknowns
+    int smoothing = 2; // Jacobi sweeps before and after the coarse correction
+};
+
+struct SolverStats
+{
+    int iterations = 0;
+    float residual = 0.f; // Relative residual when the solver stopped
+};
+
+constexpr float SOLVER_MAX_WEIGHT = 2.f; // Cap on shared side / site distance in the Laplacian
+constexpr int SOLVER_DOT_BLOCKS = 256; // Fixed blocks for the dot products, so the sums are the same for any thread count
+
+template <typename T>
+double dotProduct(const std::vector<T>& a, const std::vector<T>& b)
+{
+    const int n = static_cast<int>(a.size());
+    double partial[SOLVER_DOT_BLOCKS];
+    #pragma omp parallel for schedule(static)
+    for (int k = 0; k < SOLVER_DOT_BLOCKS; k++)
+    {
+        const int first = static_cast<int>(static_cast<long long>(n) * k / SOLVER_DOT_BLOCKS);
+        const int last = static_cast<int>(static_cast<long long>(n) * (k + 1) / SOLVER_DOT_BLOCKS);
+        double sum = 0.0;
+        for (int i = first; i < last; i++)
+        {
+            sum += static_cast<double>(a[i]) * b[i];
+        }
+        partial[k] = sum;
+    }
+    double sum = 0.0;
+    for (int k = 0; k < SOLVER_DOT_BLOCKS; k++) { sum += partial[k]; }
+    return sum;
+}
+
+// Damped Jacobi sweeps on A x = b, also the smoother of the multigrid
+inline void jacobiSweeps(const SparseMatrix& A, const std::vector<float>& b, std::vector<float>& x, int sweeps, std::vector<float>& scratch)
+{
+    const int n = A.size();
+    scratch.resize(n);
+    for (int s = 0; s < sweeps; s++)
+    {
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            float sum = b[i];
+            for (int j = A.offsets[i]; j < A.offsets[i + 1]; j++)
+            {
+                sum -= A.values[j] * x[A.cols[j]];
+            }
+            scratch[i] = x[i] + 0.67f * (sum / A.diag[i] - x[i]);
+        }
+        x.swap(scratch);
+    }
+}
+
+// Aggregation multigrid: neighbors are grouped into aggregates, each aggregate is one unknown on the next level
+// and the coarse matrix is P^T A P with the piecewise constant P, so every level stays symmetric
+class Multigrid
+{
+public:
+    void build(const SparseMatrix& fine, const SolverSettings& settings)
+    {
+        this->settings = settings;
+        levels.clear();
+        levels.push_back(Level());
+        levels[0].A = fine;
+        while (levels.back().A.size() > settings.coarseSize && levels.size() < 20)
+        {
+            Level& level = levels.back();
+            const int coarse = aggregate(level.A, level.aggregate);
+            if (coarse >= level.A.size() * 3 / 4) { break; } // Not coarsening any more
+            Level next;
+            galerkin(level.A, level.aggregate, coarse, next.A);
+            levels.push_back(next);
+        }
+    }
+
+    // z = M^-1 r with one V-cycle
+    void apply(const std::vector<float>& r, std::vector<float>& z)
+    {
+        levels[0].b = r;
+        cycle(0);
+        z = levels[0].x;
+    }
+
+    int depth() const { return static_cast<int>(levels.size()); }
+
+private:
+    struct Level
+    {
+        SparseMatrix A;
+        std::vector<int> aggregate; // Coarse unknown of every row
+        std::vector<float> x, b, residual, scratch;
+    };
+    std::vector<Level> levels;
+    SolverSettings settings;
+
+    void cycle(int l)
+    {
+        Level& level = levels[l];
+        const int n = level.A.size();
+        level.x.assign(n, 0.f);
+        if (l + 1 == static_cast<int>(levels.size()))
+        {
+            jacobiSweeps(level.A, level.b, level.x, 20, level.scratch);
+            return;
+        }
+        jacobiSweeps(level.A, level.b, level.x, settings.smoothing, level.scratch);
+
+        level.A.multiply(level.x, level.residual);
+        Level& next = levels[l + 1];
+        next.b.assign(next.A.size(), 0.f);
+        for (int i = 0; i < n; i++)
+        { // Restriction is a sum over the aggregate, done in row order so it is deterministic
+            next.b[level.aggregate[i]] += level.b[i] - level.residual[i];
+        }
+        cycle(l + 1);
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            level.x[i] += next.x[level.aggregate[i]];
+        }
+
+        jacobiSweeps(level.A, level.b, level.x, settings.smoothing, level.scratch);
+    }
+
+    // Greedy aggregation in row order: an unassigned row takes its unassigned neighbors,
+    // rows left over join the aggregate of a neighbor
+    static int aggregate(const SparseMatrix& A, std::vector<int>& aggregate)
+    {
+        const int n = A.size();
+        aggregate.assign(n, -1);
+        int count = 0;
+        for (int i = 0; i < n; i++)
+        {
+            if (aggregate[i] != -1) { continue; }
+            bool free = true;
+            for (int j = A.offsets[i]; j < A.offsets[i + 1]; j++)
+            {
+                if (aggregate[A.cols[j]] != -1) { free = false; break; }
+            }
+            if (!free) { continue; }
+            aggregate[i] = count;
+            for (int j = A.offsets[i]; j < A.offsets[i + 1]; j++)
+            {
+                aggregate[A.cols[j]] = count;
+            }
+            count++;
+        }
+        for (int i = 0; i < n; i++)
+        {
+            if (aggregate[i] != -1) { continue; }
+            for (int j = A.offsets[i]; j < A.offsets[i + 1] && aggregate[i] == -1; j++)
+            {
+                if (aggregate[A.cols[j]] >= 0) { aggregate[i] = aggregate[A.cols[j]]; }
+            }
+            if (aggregate[i] == -1) { aggregate[i] = count++; } // No neighbors
+        }
+        return count;
+    }
+
+    static void galerkin(const SparseMatrix& A, const std::vector<int>& aggregate, int coarse, SparseMatrix& C)
+    {
+        const int n = A.size();
+        C.diag.assign(coarse, 0.f);
+        std::vector<std::pair<long long, float>> entries;
+        entries.reserve(A.cols.size());
+        for (int i = 0; i < n; i++)
+        {
+            const int I = aggregate[i];
+            C.diag[I] += A.diag[i];
+            for (int j = A.offsets[i]; j < A.offsets[i + 1]; j++)
+            {
+                const int J = aggregate[A.cols[j]];
+                if (I == J) { C.diag[I] += A.values[j]; }
+                else { entries.push_back(std::pair<long long, float>(static_cast<long long>(I) * coarse + J, A.values[j])); }
+            }
+        }
+        std::stable_sort(entries.begin(), entries.end(), [](const std::pair<long long, float>& a, const std::pair<long long, float>& b) { return a.first < b.first; });
+
+        C.offsets.assign(coarse + 1, 0);
+        C.cols.clear();
+        C.values.clear();
+        for (std::size_t e = 0; e < entries.size(); e++)
+        {
+            if (e > 0 && entries[e].first == entries[e - 1].first)
+            {
+                C.values.back() += entries[e].second;
+                continue;
+            }
+            const int I = static_cast<int>(entries[e].first / coarse);
+            C.cols.push_back(static_cast<int>(entries[e].first % coarse));
+            C.values.push_back(entries[e].second);
+            C.offsets[I + 1]++;
+        }
+        for (int I = 0; I < coarse; I++) { C.offsets[I + 1] += C.offsets[I]; }
+    }
+};
+
+// Preconditioned conjugate gradients on A x = b, x holds the starting guess
+// The vectors of the iteration are doubles, in floats the residual drifts away from the real one on long solves
+SolverStats solveCG(const SparseMatrix& A, const std::vector<float>& b, std::vector<float>& x, const SolverSettings& settings = SolverSettings(), Multigrid* multigrid = nullptr)
+{
+    SolverStats stats;
+    const int n = A.size();
+    x.resize(n, 0.f);
+    std::vector<double> solution(x.begin(), x.end());
+    std::vector<double> r(n), z(n), p(n), q(n);
+    std::vector<float> r_single, z_single; // Multigrid works in floats
+    A.multiply(solution, q);
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++) { r[i] = b[i] - q[i]; }
+
+    const double norm_b = std::sqrt(dotProduct(b, b));
+    if (norm_b == 0.0)
+    {
+        std::fill(x.begin(), x.end(), 0.f);
+        return stats;
+    }
+
+    auto precondition = [&]()
+    {
+        if (multigrid)
+        {
+            r_single.assign(r.begin(), r.end());
+            multigrid->apply(r_single, z_single);
+            z.assign(z_single.begin(), z_single.end());
+            return;
+        }
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++) { z[i] = r[i] / A.diag[i]; }
+    };
+
+    precondition();
+    p = z;
+    double rz = dotProduct(r, z);
+    stats.residual = static_cast<float>(std::sqrt(dotProduct(r, r)) / norm_b);
+    while (stats.iterations < settings.maxIterations && stats.residual > settings.tolerance)
+    {
+        A.multiply(p, q);
+        const double alpha = rz / dotProduct(p, q);
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            solution[i] += alpha * p[i];
+            r[i] -= alpha * q[i];
+        }
+        stats.iterations++;
+        stats.residual = static_cast<float>(std::sqrt(dotProduct(r, r)) / norm_b);
+        if (stats.residual <= settings.tolerance) { break; }
+
+        precondition();
+        const double rz_next = dotProduct(r, z);
+        const double beta = rz_next / rz;
+        rz = rz_next;
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++) { p[i] = z[i] + beta * p[i]; }
+    }
+    x.assign(solution.begin(), solution.end());
+    return stats;
+}
+
+// area + t * L on the cell graph, L has the weight shared side / site distance on every edge
+// t is a diffusion time in square pixels, sqrt(t) is roughly how far a value spreads
+// Polygons at the map border are clipped and can have very long sides, so the weight is capped (a regular hexagon has 0.58)
+void diffusionMatrix(const CellGraph& graph, float t, SparseMatrix& A)
+{
+    const int n = graph.size();
+    A.offsets = graph.offsets;
+    A.cols = graph.adj;
+    A.values.resize(graph.adj.size());
+    A.diag.resize(n);
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        float sum = 0.f;
+        for (int j = graph.begin(i); j < graph.end(i); j++)
+        {
+            const float w = graph.edgeLength[j] > 0.f ? t * std::min(graph.edgeBorder[j] / graph.edgeLength[j], SOLVER_MAX_WEIGHT) : 0.f;
+            A.values[j] = -w;
+            sum += w;
+        }
+        A.diag[i] = std::max(graph.area[i], 1e-6f) + sum;
+    }
+}
+
+// One implicit diffusion step for float members of the cells, the matrix and the multigrid are shared by all fields
+// passes is in units of neighbor averaging rounds, one round spreads about a quarter of the squared edge length
+template <typename C>
+SolverStats diffuseFields(std::vector<C>& cells, const CellGraph& graph, std::initializer_list<float C::*> fields, float passes, const SolverSettings& settings = SolverSettings())
+{
+    SolverStats total;
+    const int n = graph.size();
+    if (n == 0 || passes <= 0.f) { return total; }
+
+    SparseMatrix A;
+    diffusionMatrix(graph, passes * 0.25f * graph.meanEdgeLength * graph.meanEdgeLength, A);
+    Multigrid multigrid;
+    if (settings.multigrid) { multigrid.build(A, settings); }
+
+    std::vector<float> value;
+    std::vector<float> b(n);
+    for (float C::* field : fields)
+    {
+        gatherField(cells, value, field);
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++) { b[i] = std::max(graph.area[i], 1e-6f) * value[i]; }
+        const SolverStats stats = solveCG(A, b, value, settings, settings.multigrid ? &multigrid : nullptr);
+        total.iterations += stats.iterations;
+        total.residual = std::max(total.residual, stats.residual);
+        scatterField(cells, value, field);
+    }
+    return total;
+}
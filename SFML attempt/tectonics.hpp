@@ -0,0 +1,206 @@
+#pragma once
+#include <vector>
+#include <atomic>
+#include <cmath>
+#include "Voronoi.hpp"
+#include "graph.hpp"
+#include "util.h"
+
+// Tectonic plates as a base layer for the heightmap
+// Plates grow from random seeds over the adjacency, each with its own growth rate, then every edge between two plates
+// is classified once as convergent (mountains, trenches) or divergent (rifts, ridges) from the relative plate motion
+
+struct PlateSettings
+{
+    int plates = 12; // Amount of plates, at most 255
+    float continentalFraction = 0.45f; // Share of plates that carry continents
+    float continentalHeight = 0.65f; // Base height of continental plates
+    float oceanicHeight = 0.3f; // Base height of oceanic plates
+    float boundaryStrength = 0.25f; // Height change for a head on collision at full speed
+    int boundarySpread = 6; // Smoothing passes that widen the boundary belts
+    float weight = 0.5f; // How much of the final height comes from the plates
+};
+
+class Plate
+{
+public:
+    int seedCell = 0;
+    float growth = 1.f; // Chance a frontier cell expands in a round
+    sf::Vector2f motion; // Drift of the plate
+    bool continental = false;
+    int numCells = 0;
+};
+
+// Multi-source region growth, level synchronous like parallel_height_gen
+// In every round each frontier cell expands with its plate's growth chance and proposes its unowned neighbors,
+// a contested cell goes to the smallest hashed proposal so the outcome does not depend on the thread order
+void growPlates(const CellGraph& graph, unsigned int seed, std::vector<Plate>& plates, std::vector<int>& owner)
+{
+    const int n = graph.size();
+    const int count = static_cast<int>(plates.size());
+    owner.assign(n, -1);
+
+    std::vector<std::atomic<int>> claimed(n); // Owner while the round is running
+    std::vector<std::atomic<unsigned int>> proposal(n); // Smallest proposal this round
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        claimed[i].store(-1, std::memory_order_relaxed);
+        proposal[i].store(0xFFFFFFFFu, std::memory_order_relaxed);
+    }
+
+    std::vector<int> frontier;
+    for (int p = 0; p < count; p++)
+    {
+        const int cell = plates[p].seedCell;
+        if (claimed[cell].load(std::memory_order_relaxed) != -1) { continue; }
+        claimed[cell].store(p, std::memory_order_relaxed);
+        frontier.push_back(cell);
+    }
+
+    std::vector<std::vector<int>> next(thread_count());
+    std::vector<std::vector<int>> candidates(thread_count());
+    unsigned int round = 0;
+    while (!frontier.empty())
+    {
+        round++;
+        // Propose neighbors, cells that do not expand this round wait in the frontier
+        #pragma omp parallel
+        {
+            std::vector<int>& local_next = next[thread_id()];
+            std::vector<int>& local_candidates = candidates[thread_id()];
+            local_next.clear();
+            local_candidates.clear();
+
+            #pragma omp for schedule(static)
+            for (int f = 0; f < static_cast<int>(frontier.size()); f++)
+            {
+                const int cell = frontier[f];
+                const int plate = claimed[cell].load(std::memory_order_relaxed);
+                if (hashRandomBetween(seed + round, cell, 0.f, 1.f) >= plates[plate].growth)
+                {
+                    local_next.push_back(cell);
+                    continue;
+                }
+                bool open = false;
+                for (int j = graph.begin(cell); j < graph.end(cell); j++)
+                {
+                    const int neighbor = graph.adj[j];
+                    if (claimed[neighbor].load(std::memory_order_relaxed) != -1) { continue; }
+                    open = true;
+                    const unsigned int key = (hash_u32(seed ^ (plate * 0x9E3779B9u), neighbor) & 0xFFFFFF00u) | static_cast<unsigned int>(plate);
+                    unsigned int current = proposal[neighbor].load(std::memory_order_relaxed);
+                    while (key < current && !proposal[neighbor].compare_exchange_weak(current, key, std::memory_order_relaxed)) {}
+                    local_candidates.push_back(neighbor);
+                }
+                if (open) { local_next.push_back(cell); }
+            }
+        }
+
+        // Resolve the proposals, the first thread to see a cell adds it to the frontier
+        for (std::size_t t = 0; t < candidates.size(); t++)
+        {
+            #pragma omp parallel for schedule(static)
+            for (int c = 0; c < static_cast<int>(candidates[t].size()); c++)
+            {
+                const int cell = candidates[t][c];
+                const int plate = static_cast<int>(proposal[cell].load(std::memory_order_relaxed) & 0xFFu);
+                int expected = -1;
+                if (claimed[cell].compare_exchange_strong(expected, plate, std::memory_order_relaxed))
+                {
+                    next[thread_id()].push_back(cell);
+                }
+            }
+        }
+
+        frontier.clear();
+        for (std::size_t t = 0; t < next.size(); t++)
+        {
+            frontier.insert(frontier.end(), next[t].begin(), next[t].end());
+        }
+        for (std::size_t t = 0; t < candidates.size(); t++)
+        {
+            for (int cell : candidates[t])
+            {
+                proposal[cell].store(0xFFFFFFFFu, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        owner[i] = claimed[i].load(std::memory_order_relaxed);
+    }
+}
+
+// Plate base layer, blended into the current heights by settings.weight
+void plate_height_gen(std::vector<Cell>& map, const CellGraph& graph, const std::vector<sf::Vector2f>& points, unsigned int seed, std::vector<Plate>& plates, const PlateSettings& settings = PlateSettings())
+{
+    const int n = graph.size();
+    if (n == 0 || settings.plates <= 0) { return; }
+    const int count = std::min(settings.plates, 255);
+
+    plates.assign(count, Plate());
+    for (int p = 0; p < count; p++)
+    {
+        const float angle = hashRandomBetween(seed + 11, p, 0.f, 2.f * PI);
+        const float speed = hashRandomBetween(seed + 12, p, 0.2f, 1.f);
+        plates[p].seedCell = hash_u32(seed + 10, p) % n;
+        plates[p].growth = hashRandomBetween(seed + 13, p, 0.3f, 1.f);
+        plates[p].motion = sf::Vector2f(speed * std::cos(angle), speed * std::sin(angle));
+        plates[p].continental = hashRandomBetween(seed + 14, p, 0.f, 1.f) < settings.continentalFraction;
+    }
+
+    std::vector<int> owner;
+    growPlates(graph, seed + 15, plates, owner);
+
+    // One pass over the edges, closing speed along the edge normal is positive for convergent boundaries
+    std::vector<float> stress(n, 0.f);
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        const int plate = owner[i];
+        if (plate < 0) { continue; }
+        float sum = 0.f;
+        for (int j = graph.begin(i); j < graph.end(i); j++)
+        {
+            const int other = owner[graph.adj[j]];
+            if (other < 0 || other == plate) { continue; }
+            const sf::Vector2f normal = (points[graph.adj[j]] - points[i]) * (1.f / graph.edgeLength[j]);
+            const sf::Vector2f relative = plates[plate].motion - plates[other].motion;
+            float closing = relative.x * normal.x + relative.y * normal.y;
+            // Oceanic crust dives under continental crust, so the oceanic side gets a trench instead of mountains
+            if (closing > 0.f && !plates[plate].continental && plates[other].continental) { closing = -0.5f * closing; }
+            sum += closing;
+        }
+        stress[i] = sum / graph.degree(i);
+    }
+
+    // Widen the belts with a few smoothing passes
+    SmoothSettings spread;
+    spread.self = 0.5f;
+    smoothGraph(graph, stress, 1, settings.boundarySpread, spread);
+
+    std::vector<int> sizes(count, 0);
+    for (int i = 0; i < n; i++)
+    {
+        if (owner[i] >= 0) { sizes[owner[i]]++; }
+    }
+    for (int p = 0; p < count; p++)
+    {
+        plates[p].numCells = sizes[p];
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        const int plate = owner[i];
+        map[i].plate = plate;
+        if (plate < 0) { continue; }
+        const float base = plates[plate].continental ? settings.continentalHeight : settings.oceanicHeight;
+        const float plate_height = clamp(base + settings.boundaryStrength * 4.f * stress[i], 1.f, 0.f);
+        map[i].height = clamp((1.f - settings.weight) * map[i].height + settings.weight * plate_height, 1.f, 0.f);
+    }
+    rise(map, graph);
+}
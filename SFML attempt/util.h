@@ -4,6 +4,11 @@
 #include <SFML/System/Vector2.hpp>
 #include <SFML/Graphics/Color.hpp>
 #include <map>
+#include <cmath>
+#include <cstring>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 inline long rand_long() // Should only be used in the case that there is a need for larger variables
 {
@@ -12,6 +17,43 @@ inline long rand_long() // Should only be used in the case that there is a need
 
 // long RAND_LONG_MAX = RAND_MAX << 15 | RAND_MAX;
 
+// Stateless per-cell random numbers, the same seed and index always give the same value no matter which thread asks
+inline unsigned int hash_u32(unsigned int seed, unsigned int index)
+{ // lowbias32 finalizer over the combined seed and index
+    unsigned int x = seed * 0x9E3779B9u ^ index;
+    x ^= x >> 16;
+    x *= 0x7FEB352Du;
+    x ^= x >> 15;
+    x *= 0x846CA68Bu;
+    x ^= x >> 16;
+    return x;
+}
+
+inline float hashRandomBetween(unsigned int seed, unsigned int index, float smallNumber, float bigNumber)
+{
+    float unit = (hash_u32(seed, index) >> 8) * (1.f / 16777216.f); // 24 bits fit exactly in a float
+    return unit * (bigNumber - smallNumber) + smallNumber;
+}
+
+// OpenMP helpers that fall back to a single thread when OpenMP is not enabled
+inline int thread_count()
+{
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+inline int thread_id()
+{
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
 inline float clamp(float x, float max, float min) 
 {
     if (x < min) { return min; }
@@ -168,6 +210,83 @@ inline size_t fast_mod(const size_t i, const size_t c)
     return i >= c ? i % c : i;
 }
 
+// Polynomial exp and log for the climate kernels, branch free so loops over them vectorize
+// Relative error is a few 1e-6, results only depend on the input so they are the same for any thread count
+inline float fast_exp(float x)
+{
+    x = std::fmin(std::fmax(x, -87.f), 88.f);
+    const float t = x * 1.44269504f; // exp(x) = 2^t
+    const float whole = std::floor(t + 0.5f);
+    const float f = t - whole; // In [-0.5, 0.5], where the Taylor series of 2^f converges fast
+    const float p = 1.f + f * (0.693147182f + f * (0.240226507f + f * (0.0555041087f + f * (0.00961812911f + f * (0.00133335581f + f * 0.000154035304f)))));
+    const unsigned int bits = static_cast<unsigned int>(static_cast<int>(whole) + 127) << 23;
+    float scale;
+    std::memcpy(&scale, &bits, sizeof(float));
+    return p * scale;
+}
+
+// Natural log of a positive normal float, the mantissa is moved to [0.707, 1.414) and log(m) = 2 atanh((m - 1) / (m + 1))
+inline float fast_log(float x)
+{
+    unsigned int bits;
+    std::memcpy(&bits, &x, sizeof(float));
+    int exponent = static_cast<int>((bits >> 23) & 0xFF) - 127;
+    bits = (bits & 0x007FFFFFu) | 0x3F800000u;
+    float m;
+    std::memcpy(&m, &bits, sizeof(float));
+    if (m > 1.41421356f) { m *= 0.5f; exponent++; }
+    const float t = (m - 1.f) / (m + 1.f);
+    const float t2 = t * t;
+    return exponent * 0.693147181f + 2.f * t * (1.f + t2 * (0.333333333f + t2 * (0.2f + t2 * 0.142857143f)));
+}
+
+// IEEE half precision for compact per cell tables, rounds to nearest even, keeps inf and nan, flushes below 6e-8 to 0
+inline unsigned short float_to_half(float value)
+{
+    unsigned int bits;
+    std::memcpy(&bits, &value, sizeof(float));
+    const unsigned short sign = static_cast<unsigned short>((bits >> 16) & 0x8000u);
+    const unsigned int magnitude = bits & 0x7FFFFFFFu;
+    if (magnitude >= 0x7F800000u) { return sign | (magnitude > 0x7F800000u ? 0x7E00u : 0x7C00u); } // nan, inf
+    if (magnitude >= 0x477FF000u) { return sign | 0x7C00u; } // Rounds past the largest half
+    if (magnitude < 0x38800000u)
+    { // Subnormal half, the implicit 1 becomes part of the mantissa
+        if (magnitude < 0x33000000u) { return sign; }
+        const unsigned int exponent = magnitude >> 23;
+        const unsigned int mantissa = (magnitude & 0x007FFFFFu) | 0x00800000u;
+        const unsigned int shift = 126u - exponent;
+        unsigned int half = mantissa >> shift;
+        const unsigned int rest = mantissa & ((1u << shift) - 1u);
+        const unsigned int halfway = 1u << (shift - 1u);
+        if (rest > halfway || (rest == halfway && (half & 1u))) { half++; }
+        return sign | static_cast<unsigned short>(half);
+    }
+    unsigned int half = ((magnitude - 0x38000000u) >> 13);
+    const unsigned int rest = magnitude & 0x1FFFu;
+    if (rest > 0x1000u || (rest == 0x1000u && (half & 1u))) { half++; } // A carry into the exponent is still correct
+    return sign | static_cast<unsigned short>(half);
+}
+
+inline float half_to_float(unsigned short half)
+{
+    const unsigned int sign = static_cast<unsigned int>(half & 0x8000u) << 16;
+    const unsigned int exponent = (half >> 10) & 0x1Fu;
+    unsigned int mantissa = half & 0x3FFu;
+    unsigned int bits;
+    if (exponent == 0x1Fu) { bits = sign | 0x7F800000u | (mantissa << 13); }
+    else if (exponent != 0) { bits = sign | ((exponent + 112u) << 23) | (mantissa << 13); }
+    else if (mantissa == 0) { bits = sign; }
+    else
+    { // Subnormal half, normalize it
+        int e = 113;
+        while (!(mantissa & 0x400u)) { mantissa <<= 1; e--; }
+        bits = sign | (static_cast<unsigned int>(e) << 23) | ((mantissa & 0x3FFu) << 13);
+    }
+    float value;
+    std::memcpy(&value, &bits, sizeof(float));
+    return value;
+}
+
 // monotonically increases with real angle, used for delaunay
 inline double pseudo_angle(const double dx, const double dy) 
 {
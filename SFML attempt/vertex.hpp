@@ -1,6 +1,11 @@
 #pragma once
 #include <SFML/Graphics.hpp>
 
+// Color of a cell on the height map
+inline sf::Color heightColor(const Cell& cell) {
+	return sf::Color((128 * (1 - cell.oceanBool)), (255 * (1 - cell.oceanBool)), 255 / 3 * (cell.oceanBool + (2 - cell.riverBool - cell.lakeBool)), 55 + (sf::Uint8)std::abs(std::ceil(200 * cell.height)));
+}
+
 class VertexMap {
 public:
 	sf::VertexBuffer vertexBuffer = sf::VertexBuffer(sf::Triangles, sf::VertexBuffer::Dynamic);
@@ -13,7 +18,7 @@ public:
 	void genVertexMap(vor::Voronoi& map) {
 		if (useVertexBuffer) {
 			for (std::size_t i = 0; i < map.cells.size(); i++) {
-				sf::Color color((128 * (1 - map.cells[i].oceanBool)), (255 * (1 - map.cells[i].oceanBool)), 255 / 3 * (map.cells[i].oceanBool + (2 - map.cells[i].riverBool - map.cells[i].lakeBool)), 55 + (sf::Uint8)std::abs(std::ceil(200 * map.cells[i].height)));
+				sf::Color color = heightColor(map.cells[i]);
 				for (size_t j = map.cells[i].vertex_offset; j < map.cells[i].vertex_offset + map.cells[i].vertex.size() * 3; j++) {
 					map.vertices[j].color = color;
 				}
@@ -22,7 +27,7 @@ public:
 		}
 		else {
 			for (std::size_t i = 0; i < map.cells.size(); i++) {
-				sf::Color color((128 * (1 - map.cells[i].oceanBool)), (255 * (1 - map.cells[i].oceanBool)), 255 / 3 * (map.cells[i].oceanBool + (2 - map.cells[i].riverBool - map.cells[i].lakeBool)), 55 + (sf::Uint8)std::abs(std::ceil(200 * map.cells[i].height)));
+				sf::Color color = heightColor(map.cells[i]);
 				for (size_t j = map.cells[i].vertex_offset; j < map.cells[i].vertex_offset + map.cells[i].vertex.size() * 3; j++) {
 					map.vertices[j].color = color;
 				}
@@ -70,6 +75,36 @@ public:
 		}
 	}
 
+	// Recolor a few cells on the height map and upload only their vertices
+	// Each cell is its own small upload, so past an eighth of the map one full upload is cheaper
+	void updateCells(vor::Voronoi& map, const std::vector<int>& cells) {
+		for (int i : cells) {
+			sf::Color color = heightColor(map.cells[i]);
+			for (size_t j = map.cells[i].vertex_offset; j < map.cells[i].vertex_offset + map.cells[i].vertex.size() * 3; j++) {
+				map.vertices[j].color = color;
+			}
+		}
+		if (useVertexBuffer) {
+			if (cells.size() * 8 > map.cells.size()) {
+				vertexBuffer.update(map.vertices.data());
+				return;
+			}
+			for (int i : cells) {
+				vertexBuffer.update(map.vertices.data() + map.cells[i].vertex_offset, map.cells[i].vertex.size() * 3, map.cells[i].vertex_offset);
+			}
+		}
+		else if (vertexArray.getVertexCount() == map.vertices.size()) {
+			for (int i : cells) {
+				for (size_t j = map.cells[i].vertex_offset; j < map.cells[i].vertex_offset + map.cells[i].vertex.size() * 3; j++) {
+					vertexArray[j].color = map.vertices[j].color;
+				}
+			}
+		}
+		else {
+			update(map);
+		}
+	}
+
 	void switchOrigin(vor::Voronoi& map) {
 		if (!sf::VertexBuffer::isAvailable()) { return; }
 